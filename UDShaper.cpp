@@ -56,9 +56,40 @@ UDShaper::UDShaper(const InstanceInfo& info)
     param->InitDouble(name.c_str(), 0., -1., 1., 0.01);
   }
 
+  param = GetParam(EParams::modRate);
+  param->InitEnum("Modulation rate", 0, 5);
+  param->SetDisplayText(0, "Audio rate");
+  param->SetDisplayText(1, "8 samples");
+  param->SetDisplayText(2, "16 samples");
+  param->SetDisplayText(3, "32 samples");
+  param->SetDisplayText(4, "64 samples");
+
+  param = GetParam(EParams::modInterpolation);
+  param->InitEnum("Modulation interpolation", 0, 2);
+  param->SetDisplayText(0, "Linear");
+  param->SetDisplayText(1, "Smoothstep");
+
+  param = GetParam(EParams::normalizeHysteresis);
+  param->InitDouble("Normalization hysteresis", 0., 0., 0.1, 0.001);
+
+  param = GetParam(EParams::normalizeMode);
+  param->InitEnum("Normalization mode", 0, 2);
+  param->SetDisplayText(0, "Lookahead");
+  param->SetDisplayText(1, "Predictive");
+
+  param = GetParam(EParams::normalizeFrequency);
+  param->InitFrequency("Normalization lowest frequency", NORMALIZE_FREQUENCY_DEFAULT, NORMALIZE_FREQUENCY_MIN, NORMALIZE_FREQUENCY_MAX, 0.01);
+
   // Inform the LFOController about the default parameter values.
   LFOs.refreshInternalState();
 
+#if IPLUG_DSP
+  // Hosts call OnReset before processing, but the buffers must be valid in any case.
+  allocateBuffers();
+  updateNormalizeLatency();
+  reportLatency();
+#endif
+
 #if IPLUG_EDITOR
   mMakeGraphicsFunc = [&]() {
     return MakeGraphics(*this, PLUG_WIDTH, PLUG_HEIGHT, PLUG_FPS, GetScaleForScreen(PLUG_WIDTH, PLUG_HEIGHT));
@@ -94,48 +125,228 @@ UDShaper::UDShaper(const InstanceInfo& info)
 }
 
 #if IPLUG_DSP
-void UDShaper::modulationStep(double (&modAmps)[MAX_NUMBER_LFOS * MAX_MODULATION_LINKS], double& beatPosition, double& seconds)
+void UDShaper::modulationTick(const CompiledCurve& curve1, const CompiledCurve& curve2)
 {
-  // Calculate modulation amplitudes at current time step.
-  LFOs.getModulationAmplitudes(beatPosition, seconds, modAmps, modulationAmounts);
+  // The functions of the next tick become the functions of the previous tick.
+  std::swap(mResolved1, mResolvedPrevious1);
+  std::swap(mResolved2, mResolvedPrevious2);
+
+  // Without a previous tick, start from the current modulation state.
+  if (!mModulationActive && (mModulationInterval > 1))
+  {
+    LFOs.getModulationAmplitudes(mLFOClock, 0, mModulationAmplitudes, modulationAmounts);
+    curve1.resolve(mModulationAmplitudes, mResolvedPrevious1);
+    curve2.resolve(mModulationAmplitudes, mResolvedPrevious2);
+  }
 
-  // Increase time by one sample.
-  beatPosition += GetTempo() / GetSampleRate() / 60;
-  seconds += 1. / GetSampleRate();
+  // At audio rate, the functions are resolved at the current sample.
+  int offset = (mModulationInterval > 1) ? mModulationInterval : 0;
+  LFOs.getModulationAmplitudes(mLFOClock, offset, mModulationAmplitudes, modulationAmounts);
+  curve1.resolve(mModulationAmplitudes, mResolved1);
+  curve2.resolve(mModulationAmplitudes, mResolved2);
+}
+
+iplug::sample UDShaper::shapeModulated(bool useCurve1, iplug::sample input, CurveCursor& cursor1, CurveCursor& cursor2, float weight) const
+{
+  const ResolvedCurve& next = useCurve1 ? mResolved1 : mResolved2;
+  CurveCursor& cursor = useCurve1 ? cursor1 : cursor2;
+
+  if (mModulationInterval == 1)
+  {
+    return next.forward(input, &cursor);
+  }
+
+  const ResolvedCurve& previous = useCurve1 ? mResolvedPrevious1 : mResolvedPrevious2;
+  float outPrevious = previous.forward(input, &cursor);
+  return outPrevious + weight * (next.forward(input, &cursor) - outPrevious);
 }
 
 void UDShaper::clearBuffer()
 {
-  // Aparently this is a good way to clear queues.
-  std::queue<iplug::sample> emptyL;
-  std::swap(mBufferL, emptyL);
+  mBufferL.clear();
+  mBufferR.clear();
+  mPOIsL.clear();
+  mPOIsR.clear();
+}
 
-  std::queue<iplug::sample> emptyR;
-  std::swap(mBufferR, emptyR);
+void UDShaper::allocateBuffers()
+{
+  // The delay line holds the latency plus the chunk that is currently loaded.
+  int maxLatency = static_cast<int>(std::ceil(GetSampleRate() / NORMALIZE_FREQUENCY_MIN));
+  mBufferL.allocate(maxLatency + PROCESS_CHUNK_SIZE);
+  mBufferR.allocate(maxLatency + PROCESS_CHUNK_SIZE);
+  mPOIsL.allocate(maxLatency);
+  mPOIsR.allocate(maxLatency);
+}
+
+int UDShaper::getLookahead(double frequency) const
+{
+  int latency = getLookaheadSamples(GetSampleRate(), frequency);
 
-  mPOIOffsetL.clear();
-  mPOIOffsetR.clear();
-  mPOILevelL.clear();
-  mPOILevelR.clear();
+  // The buffers may have been allocated for a lower sample rate.
+  return std::clamp(latency, 1, mBufferL.capacity() - PROCESS_CHUNK_SIZE);
 }
 
-void UDShaper::ProcessBlock(sample** inputs, sample** outputs, int nFrames)
+void UDShaper::updateNormalizeLatency()
 {
-  sample* inputL = inputs[0];
-  sample* inputR = inputs[1];
+  mNormalizeLatency = getLookahead(mNormalizeFrequency);
+  mPredictorDecay = std::exp(-mNormalizeFrequency / (GetSampleRate() * NORMALIZE_PREDICTOR_RELEASE));
 
-  sample* outputL = outputs[0];
-  sample* outputR = outputs[1];
+  clearBuffer();
+  mPOIsL.offsetCount = 0;
+  mPOIsR.offsetCount = 0;
+  mPredictorL = POIPredictor();
+  mPredictorR = POIPredictor();
+  mSilentSamples = 0;
+}
+
+void UDShaper::reportLatency()
+{
+  bool normalize = GetParam(EParams::normalize)->Value();
+  normalizationMode mode = static_cast<normalizationMode>(GetParam(EParams::normalizeMode)->Value());
+  SetLatency((normalize && (mode == normalizeLookahead)) ? getLookahead(GetParam(EParams::normalizeFrequency)->Value()) : 0);
+}
+
+bool UDShaper::isProcessingParam(int idx)
+{
+  return (idx == EParams::distMode) || (idx == EParams::normalize) || ((EParams::modStart <= idx) && (idx < EParams::kNumParams));
+}
 
-  double beatPosition = GetPPQPos();
-  double secondsPlayed = GetSamplePos() / GetSampleRate();
+void UDShaper::applyParamChange(int idx, double value)
+{
+  if (idx == EParams::distMode)
+  {
+    mMode = static_cast<distortionMode>(value);
+  }
+  else if (idx == EParams::normalize)
+  {
+    mNormalize = value;
+    updateNormalizeLatency();
+  }
+  else if (idx == EParams::normalizeFrequency)
+  {
+    mNormalizeFrequency = value;
+    updateNormalizeLatency();
+  }
+  else if (idx == EParams::normalizeMode)
+  {
+    mNormalizeMode = static_cast<normalizationMode>(value);
+    updateNormalizeLatency();
+  }
+  else if (idx == EParams::normalizeHysteresis)
+  {
+    mPOIHysteresis = value;
+
+    // Silent samples may complete a POI with a lower hysteresis.
+    mSilentSamples = 0;
+  }
+  else if ((idx == EParams::modRate) || (idx == EParams::modInterpolation))
+  {
+    if (idx == EParams::modRate)
+    {
+      mModulationInterval = MODULATION_RATES[static_cast<int>(value)];
+    }
+    else
+    {
+      mModulationSmoothing = static_cast<modulationSmoothing>(value);
+    }
+
+    // Restart the modulation ticks with the new interval.
+    mModulationActive = false;
+  }
+  // Udpade the internal modulation amount state if a link knob has been changed.
+  else if ((EParams::modStart <= idx) && (idx < EParams::modRate))
+  {
+    modulationAmounts[idx - EParams::modStart] = value;
+  }
+}
+
+void UDShaper::applyFlaggedParamChanges()
+{
+  if (!mAnyParamChanged.exchange(false))
+  {
+    return;
+  }
+
+  for (int idx = 0; idx < EParams::kNumParams; idx++)
+  {
+    if (mParamChanged[idx].exchange(false))
+    {
+      applyParamChange(idx, GetParam(idx)->Value());
+    }
+  }
+}
+
+template <distortionMode Mode, bool Normalize, normalizationMode NormalizeMode>
+void UDShaper::prepareChunk(const iplug::sample* inputL, const iplug::sample* inputR, int n)
+{
+#if defined(UDS_SIMD) && !defined(SAMPLE_TYPE_FLOAT)
+  // Without normalization, up/down mode only tracks the direction of both channels.
+  // The channels are processed in the two lanes of a SIMDStereo, which avoids branches.
+  // Only this path is packed into lanes. With normalization, the direction of each channel
+  // follows from its POI queue or predictor, which are sequential per channel and stay scalar
+  // below. The shaping functions are vectorized over time in CompiledCurve::forwardBlock
+  // instead, which fills more lanes than the two channels.
+  if constexpr (!Normalize && (Mode == upDown))
+  {
+    SIMDStereo previous = simdStereoSet(mFrontSampleL.previousLevel, mFrontSampleR.previousLevel);
+    SIMDStereo increasing = simdStereoMask(mFrontSampleL.isIncreasing, mFrontSampleR.isIncreasing);
+
+    for (int i = 0; i < n; i++)
+    {
+      // The direction only changes if the level changes.
+      SIMDStereo level = simdStereoSet(inputL[i], inputR[i]);
+      increasing = simdStereoSelect(simdStereoNotEqual(level, previous), simdStereoGreater(level, previous), increasing);
+      previous = level;
+
+      int mask = simdStereoMoveMask(increasing);
+      mUseCurve1L[i] = mask & 1;
+      mUseCurve1R[i] = mask & 2;
+    }
+
+    std::copy(inputL, inputL + n, mShapeInL);
+    std::copy(inputR, inputR + n, mShapeInR);
+
+    int mask = simdStereoMoveMask(increasing);
+    mFrontSampleL.isIncreasing = mask & 1;
+    mFrontSampleR.isIncreasing = mask & 2;
+    if (n > 0)
+    {
+      mFrontSampleL.previousLevel = inputL[n - 1];
+      mFrontSampleR.previousLevel = inputR[n - 1];
+    }
+    return;
+  }
+#endif
 
-  // Fetch the state of all modulation amplitudes at the given host beatPosition or time.
-  double modAmps[MAX_NUMBER_LFOS * MAX_MODULATION_LINKS] = {};
+  // With lookahead, the whole chunk is loaded to the buffers and searched for POIs
+  // before the samples at the front of the buffers are normalized.
+  if constexpr (Normalize && (NormalizeMode == normalizeLookahead))
+  {
+    // ----- Load to buffer -----
+    for (int i = 0; i < n; i++)
+    {
+      // Transform to mid/side if necessary.
+      if constexpr (Mode == midSide)
+      {
+        mBackChunkL[i] = (inputL[i] + inputR[i]) * 0.5;
+        mBackChunkR[i] = (inputL[i] - inputR[i]) * 0.5;
+      }
+      else
+      {
+        mBackChunkL[i] = inputL[i];
+        mBackChunkR[i] = inputR[i];
+      }
+      mBufferL.push(mBackChunkL[i]);
+      mBufferR.push(mBackChunkR[i]);
+    }
 
-  bool isPlaying = GetTransportIsRunning();
+    // ----- Check for POIs -----
+    mPOIsL.detectChunk(mBackChunkL, n, mPOIHysteresis, mNormalizeLatency);
+    mPOIsR.detectChunk(mBackChunkR, n, mPOIHysteresis, mNormalizeLatency);
+  }
 
-  for (int i = 0; i < nFrames; i++)
+  for (int i = 0; i < n; i++)
   {
     // Value of the current sample after normalizing (left channel).
     // If the distortion mode is set to mid/side, this represents
@@ -147,84 +358,35 @@ void UDShaper::ProcessBlock(sample** inputs, sample** outputs, int nFrames)
     // the side channel.
     iplug::sample inputSampleR = inputR[i];
 
-    // If normalization is active, load input audio to buffers, load
-    // front sample from buffer and apply normalization.
-    if (mNormalize)
+    // Without lookahead, normalize each sample to the predicted POI range.
+    if constexpr (Normalize && (NormalizeMode == normalizePredictive))
     {
-      // ----- Load to buffer -----
       // Transform to mid/side if necessary.
-      if (mMode == distortionMode::midSide)
+      if constexpr (Mode == midSide)
       {
-        mBufferL.push((inputL[i] + inputR[i]) * 0.5);
-        mBufferR.push((inputL[i] - inputR[i]) * 0.5);
-      }
-      else
-      {
-        mBufferL.push(inputL[i]);
-        mBufferR.push(inputR[i]);
+        inputSampleL = (inputL[i] + inputR[i]) * 0.5;
+        inputSampleR = (inputL[i] - inputR[i]) * 0.5;
       }
 
-      // ----- Check for POIs -----
-      // Check for changes in the sign or direction and update POI buffer.
-      // Samples that are zero do not need to be normalized and can be excluded
-      // from sign/ direction evaluation.
-      bool signChangeL = (mBackSampleL.previousLevel != 0) && (mBackSampleL.isPositive != (mBufferL.back() > 0));
-      bool directionChangeL = (mBackSampleL.previousLevel != mBufferL.back()) && (mBackSampleL.isIncreasing != (mBufferL.back() > mBackSampleL.previousLevel));
-
-      // Points can have both a change in sign and direction (e.g. at points
-      // where a saw wave jumps). If this happens, the level should be written
-      // to the POIAmp buffer. If only the sign changes, write zero.
-      if (directionChangeL)
-      {
-        mPOILevelL.push_back(mBackSampleL.previousLevel);
-        mBackSampleL.isIncreasing = mBufferL.back() > mBackSampleL.previousLevel;
-        mBackSampleL.isPositive = mBufferL.back() > 0;
-        mPOIOffsetL.push_back(mPOIOffsetCountL);
-        mPOIOffsetCountL = 0;
-      }
-      else if (signChangeL)
-      {
-        mPOILevelL.push_back(0.);
-        mBackSampleL.isPositive = mBufferL.back() > 0;
-        mPOIOffsetL.push_back(mPOIOffsetCountL);
-        mPOIOffsetCountL = 0;
-      }
+      mPredictorL.process(inputSampleL, mPOIHysteresis, mPredictorDecay, mNormL);
+      mPredictorR.process(inputSampleR, mPOIHysteresis, mPredictorDecay, mNormR);
+      mFrontSampleL.isIncreasing = mPredictorL.isIncreasing();
+      mFrontSampleR.isIncreasing = mPredictorR.isIncreasing();
 
-      bool signChangeR = (mBackSampleR.previousLevel != 0) && ((mBackSampleR.isPositive) != (mBufferR.back() > 0));
-      bool directionChangeR = (mBackSampleR.previousLevel != mBufferR.back()) && (mBackSampleR.isIncreasing != mBufferR.back() > mBackSampleR.previousLevel);
-      if (directionChangeR)
-      {
-        mPOILevelR.push_back(mBackSampleR.previousLevel);
-        mBackSampleR.isIncreasing = mBufferR.back() > mBackSampleR.previousLevel;
-        mBackSampleR.isPositive = mBufferR.back() > 0;
-        mPOIOffsetR.push_back(mPOIOffsetCountR);
-        mPOIOffsetCountR = 0;
-      }
-      else if (signChangeR)
-      {
-        mPOILevelR.push_back(0.);
-        mBackSampleR.isPositive = mBufferR.back() > 0;
-        mPOIOffsetR.push_back(mPOIOffsetCountR);
-        mPOIOffsetCountR = 0;
-      }
-
-      // Count the samples since the last POI.
-      // The offset can not be larger than the buffer size.
-      if (mPOIOffsetCountL < LATENCY_NORMALIZE)
-      {
-        mPOIOffsetCountL++;
-      }
-      if (mPOIOffsetCountR < LATENCY_NORMALIZE)
-      {
-        mPOIOffsetCountR++;
-      }
-
-      mBackSampleL.previousLevel = mBufferL.back();
-      mBackSampleR.previousLevel = mBufferR.back();
+      mChunkNormL[i] = mNormL;
+      mChunkNormR[i] = mNormR;
+    }
 
+    // If normalization is active, load the front sample from the buffer
+    // and update its normalizer.
+    else if constexpr (Normalize)
+    {
       // ----- Update POIs at front of buffer -----
+      // The samples after i have already been loaded to the buffers and searched for POIs.
+      int pendingSamples = n - 1 - i;
+
       // Only process if enough samples have been loaded to the buffers.
-      if (mBufferL.size() > LATENCY_NORMALIZE)
+      if (mBufferL.size() - pendingSamples > mNormalizeLatency)
       {
         inputSampleL = mBufferL.front();
         inputSampleR = mBufferR.front();
@@ -232,36 +394,27 @@ void UDShaper::ProcessBlock(sample** inputs, sample** outputs, int nFrames)
         mBufferR.pop();
 
         // Apply normalization to this sample.
-        // Count down until the next POI index is reached and update mNormL and
-        // mNormR.
-        if (!mPOIOffsetL.empty() && --mPOIOffsetL.front() <= 0)
+        if (mPOIsL.advanceFront(i, n, mNormL))
         {
-          // The level of the next sample is the second element in mPOILevel.
-          if (mPOIOffsetL.size() > 1)
-          {
-            mNormL.setNextLevel(mPOILevelL.at(1));
-            mPOILevelL.pop_front();
-            mPOIOffsetL.pop_front();
-            mFrontSampleL.isIncreasing = mNormL.isIncreasing();
-          }
+          mFrontSampleL.isIncreasing = mNormL.isIncreasing();
         }
-        if (!mPOIOffsetR.empty() && --mPOIOffsetR.front() <= 0)
+        if (mPOIsR.advanceFront(i, n, mNormR))
         {
-          if (mPOIOffsetR.size() > 1)
-          {
-            mNormR.setNextLevel(mPOILevelR.at(1));
-            mPOILevelR.pop_front();
-            mPOIOffsetR.pop_front();
-            mFrontSampleR.isIncreasing = mNormR.isIncreasing();
-          }
+          mFrontSampleR.isIncreasing = mNormR.isIncreasing();
         }
 
-        inputSampleL = mNormL.normalize(inputSampleL);
-        inputSampleR = mNormR.normalize(inputSampleR);
+        mChunkNormL[i] = mNormL;
+        mChunkNormR[i] = mNormR;
       }
+
+      // While the buffer is being filled, output silence. A zero input with a
+      // neutral normalizer results in a zero output.
       else
       {
-        continue;
+        inputSampleL = 0.;
+        inputSampleR = 0.;
+        mChunkNormL[i] = POINormalizer();
+        mChunkNormR[i] = POINormalizer();
       }
     }
 
@@ -269,149 +422,445 @@ void UDShaper::ProcessBlock(sample** inputs, sample** outputs, int nFrames)
     // process up/down distortion properly.
     else
     {
-      if ((mFrontSampleL.previousLevel != inputL[i]) && (mFrontSampleL.isIncreasing != inputL[i] > mFrontSampleL.previousLevel))
+      if constexpr (Mode == upDown)
       {
-        mFrontSampleL.isIncreasing = !mFrontSampleL.isIncreasing;
+        if ((mFrontSampleL.previousLevel != inputL[i]) && (mFrontSampleL.isIncreasing != inputL[i] > mFrontSampleL.previousLevel))
+        {
+          mFrontSampleL.isIncreasing = !mFrontSampleL.isIncreasing;
+        }
+
+        if ((mFrontSampleR.previousLevel != inputR[i]) && (mFrontSampleR.isIncreasing != inputR[i] > mFrontSampleR.previousLevel))
+        {
+          mFrontSampleR.isIncreasing = !mFrontSampleR.isIncreasing;
+        }
       }
 
-      if ((mFrontSampleR.previousLevel != inputR[i]) && (mFrontSampleR.isIncreasing != inputR[i] > mFrontSampleR.previousLevel))
+      // If normalization is used, left/right has already been transformed
+      // to mid/side in the buffer. If not, transform here.
+      if constexpr (Mode == midSide)
       {
-        mFrontSampleR.isIncreasing = !mFrontSampleR.isIncreasing;
+        inputSampleL = (inputL[i] + inputR[i]) * 0.5;
+        inputSampleR = (inputL[i] - inputR[i]) * 0.5;
       }
     }
 
-    // Do not process modulation unless the host is playing.
-    if (isPlaying)
+    mShapeInL[i] = inputSampleL;
+    mShapeInR[i] = inputSampleR;
+
+    // ----- Select shaping function -----
+    // Distortion mode Up/Down:
+    // Use shapeEditor1 on samples that have higher or equal value than the
+    // previous sample, else use shapeEditor2.
+    if constexpr (Mode == upDown)
     {
-      modulationStep(modAmps, beatPosition, secondsPlayed);
+      mUseCurve1L[i] = mFrontSampleL.isIncreasing;
+      mUseCurve1R[i] = mFrontSampleR.isIncreasing;
+
+      mFrontSampleL.previousLevel = inputSampleL;
+      mFrontSampleR.previousLevel = inputSampleR;
     }
 
-    // ----- Process audio -----
-    switch (mMode)
+    // Distortion mode Mid/Side:
+    // Use shapeEditor1 on the mid-, shapeEditor2 on the side-channel.
+    // Distortion mode Left/Right:
+    // Use shapeEditor1 on the left, shapeEditor2 on the right channel.
+    else if constexpr ((Mode == midSide) || (Mode == leftRight))
     {
-      // Distortion mode Up/Down:
-      // Use shapeEditor1 on samples that have higher or equal value than the
-      // previous sample, else use shapeEditor2.
-      case upDown:
+      mUseCurve1L[i] = true;
+      mUseCurve1R[i] = false;
+    }
+
+    // Distortion mode +/-:
+    // Use shapeEditor one on positive, shapeEditor2 on negative samples.
+    // The sign is taken after normalization.
+    else if constexpr (Mode == positiveNegative)
+    {
+      if constexpr (Normalize)
       {
-        // Forward (normalized) input values to the corresponding ShapeEditors.
-        if (mFrontSampleL.isIncreasing)
-        {
-          outputL[i] = shapeEditor1.forward(inputSampleL, modAmps);
-        }
-        else
-        {
-          outputL[i] = shapeEditor2.forward(inputSampleL, modAmps);
-        }
+        inputSampleL = mChunkNormL[i].normalize(inputSampleL);
+        inputSampleR = mChunkNormR[i].normalize(inputSampleR);
+      }
+      mUseCurve1L[i] = inputSampleL > 0;
+      mUseCurve1R[i] = inputSampleR > 0;
+    }
+  }
+}
 
-        if (mFrontSampleR.isIncreasing)
-        {
-          outputR[i] = shapeEditor1.forward(inputSampleR, modAmps);
-        }
-        else
-        {
-          outputR[i] = shapeEditor2.forward(inputSampleR, modAmps);
-        }
+// Evaluates the shaping functions on one channel of a chunk, each sample with the
+// function selected by useCurve1.
+// norms is passed on to CompiledCurve::forwardBlock, nullptr if normalization is off.
+//
+// If both functions are needed, the samples are partitioned by function, each function
+// is evaluated on its partition in one batch and the results are scattered back. The
+// partitioning has no data-dependent branches, which would be unpredictable on noisy audio.
+// * @param order Scratch buffer for the sample indices in partitioned order
+// * @param partitioned Scratch buffer for the samples in partitioned order
+static void shapeChannel(const CompiledCurve& curve1, const CompiledCurve& curve2, CurveCursor& cursor1, CurveCursor& cursor2, const iplug::sample* input, const bool* useCurve1, const POINormalizer* norms, iplug::sample* output, int* order, iplug::sample* partitioned, int n)
+{
+  int count1 = 0;
+  for (int i = 0; i < n; i++)
+  {
+    count1 += useCurve1[i];
+  }
+  int count2 = n - count1;
 
-        if (mNormalize)
-        {
-          outputL[i] = mNormL.revertNormalize(outputL[i]);
-          outputR[i] = mNormR.revertNormalize(outputR[i]);
-        }
+  if (count2 == 0)
+  {
+    curve1.forwardBlock(input, output, n, nullptr, &cursor1, norms);
+    return;
+  }
+  if (count1 == 0)
+  {
+    curve2.forwardBlock(input, output, n, nullptr, &cursor2, norms);
+    return;
+  }
 
-        mFrontSampleL.previousLevel = inputSampleL;
-        mFrontSampleR.previousLevel = inputSampleR;
-        
-        break;
-      }
+  // The indices of samples of curve1 are written to the front of order, the ones of curve2
+  // behind them. Both partitions keep the time order of the samples, which CurveCursor relies on.
+  // The select of the write position compiles to a conditional move.
+  int next1 = 0;
+  int next2 = count1;
+  for (int i = 0; i < n; i++)
+  {
+    order[useCurve1[i] ? next1 : next2] = i;
+    next1 += useCurve1[i];
+    next2 += !useCurve1[i];
+  }
 
-      // Distortion mode Mid/Side:
-      // Use shapeEditor1 on the mid-, shapeEditor2 on the side-channel.
-      case midSide:
-      {
-        iplug::sample mid = 0;
-        iplug::sample side = 0;
+  for (int k = 0; k < n; k++)
+  {
+    partitioned[k] = norms ? norms[order[k]].normalize(input[order[k]]) : input[order[k]];
+  }
 
-        // If normalization is used, left/right has already been transformed
-        // to mid/side in the buffer. If not, transform here.
-        if (mNormalize)
-        {
-          mid = shapeEditor1.forward(inputSampleL, modAmps);
-          side = shapeEditor2.forward(inputSampleR, modAmps);
+  curve1.forwardBlock(partitioned, partitioned, count1, nullptr, &cursor1);
+  curve2.forwardBlock(partitioned + count1, partitioned + count1, count2, nullptr, &cursor2);
 
-          mid = mNormL.revertNormalize(mid);
-          side = mNormR.revertNormalize(side);
-        }
-        else
-        {
-          mid = shapeEditor1.forward((inputSampleL + inputSampleR) * 0.5, modAmps);
-          side = shapeEditor2.forward((inputSampleL - inputSampleR) * 0.5, modAmps);
-        }
+  for (int k = 0; k < n; k++)
+  {
+    output[order[k]] = norms ? norms[order[k]].revertNormalize(partitioned[k]) : partitioned[k];
+  }
+}
 
-        outputL[i] = mid + side;
-        outputR[i] = mid - side;
+template <bool Normalize>
+void UDShaper::shapeChunk(const CompiledCurve& curve1, const CompiledCurve& curve2, int n)
+{
+  shapeChannel(curve1, curve2, mCursor1L, mCursor2L, mShapeInL, mUseCurve1L, Normalize ? mChunkNormL : nullptr, mShapeOutL, mPartitionOrder, mPartitioned, n);
+  shapeChannel(curve1, curve2, mCursor1R, mCursor2R, mShapeInR, mUseCurve1R, Normalize ? mChunkNormR : nullptr, mShapeOutR, mPartitionOrder, mPartitioned, n);
+}
 
-        break;
-      }
+template <bool Normalize>
+void UDShaper::shapeChunkModulated(const CompiledCurve& curve1, const CompiledCurve& curve2, int n, int& clockLag)
+{
+  for (int i = 0; i < n; i++)
+  {
+    // Resolve the positions of modulated points once per tick for both channels.
+    if (!mModulationActive || (mModulationCounter >= mModulationInterval))
+    {
+      mModulationCounter = 0;
+      mLFOClock.advance(clockLag);
+      clockLag = 0;
+      modulationTick(curve1, curve2);
+      mModulationActive = true;
+    }
 
-      // Distortion mode Left/Right:
-      // Use shapeEditor1 on the left, shapeEditor2 on the right channel.
-      case leftRight:
-      {
-        outputL[i] = shapeEditor1.forward(inputSampleL, modAmps);
-        outputR[i] = shapeEditor2.forward(inputSampleR, modAmps);
+    float weight = static_cast<float>(mModulationCounter) / mModulationInterval;
+    if (mModulationSmoothing == smoothingSmoothstep)
+    {
+      weight = weight * weight * (3 - 2 * weight);
+    }
 
-        if (mNormalize)
-        {
-          outputL[i] = mNormL.revertNormalize(outputL[i]);
-          outputR[i] = mNormR.revertNormalize(outputR[i]);
-        }
+    if constexpr (Normalize)
+    {
+      mShapeOutL[i] = mChunkNormL[i].revertNormalize(shapeModulated(mUseCurve1L[i], mChunkNormL[i].normalize(mShapeInL[i]), mCursor1L, mCursor2L, weight));
+      mShapeOutR[i] = mChunkNormR[i].revertNormalize(shapeModulated(mUseCurve1R[i], mChunkNormR[i].normalize(mShapeInR[i]), mCursor1R, mCursor2R, weight));
+    }
+    else
+    {
+      mShapeOutL[i] = shapeModulated(mUseCurve1L[i], mShapeInL[i], mCursor1L, mCursor2L, weight);
+      mShapeOutR[i] = shapeModulated(mUseCurve1R[i], mShapeInR[i], mCursor1R, mCursor2R, weight);
+    }
 
-        break;
-      }
+    mModulationCounter++;
+    clockLag++;
+  }
+}
 
-      // Distortion mode +/-:
-      // Use shapeEditor one on positive, shapeEditor2 on negative samples.
-      case positiveNegative:
-      {
-        outputL[i] = (inputSampleL > 0) ? shapeEditor1.forward(inputSampleL, modAmps) : shapeEditor2.forward(inputSampleL, modAmps);
-        outputR[i] = (inputSampleR > 0) ? shapeEditor1.forward(inputSampleR, modAmps) : shapeEditor2.forward(inputSampleR, modAmps);
+template <distortionMode Mode>
+void UDShaper::finishChunk(iplug::sample* outputL, iplug::sample* outputR, int n)
+{
+  if constexpr (Mode == midSide)
+  {
+    for (int i = 0; i < n; i++)
+    {
+      outputL[i] = mShapeOutL[i] + mShapeOutR[i];
+      outputR[i] = mShapeOutL[i] - mShapeOutR[i];
+    }
+  }
+  else
+  {
+    std::copy(mShapeOutL, mShapeOutL + n, outputL);
+    std::copy(mShapeOutR, mShapeOutR + n, outputR);
+  }
+}
 
-        if (mNormalize)
-        {
-          outputL[i] = mNormL.revertNormalize(outputL[i]);
-          outputR[i] = mNormR.revertNormalize(outputR[i]);
-        }
+// * @return true if all n samples are equal
+static bool isConstant(const iplug::sample* input, int n)
+{
+  bool constant = true;
+  for (int i = 1; i < n; i++)
+  {
+    constant &= (input[i] == input[0]);
+  }
+  return constant;
+}
 
-        break;
-      }
+template <distortionMode Mode, bool Normalize, normalizationMode NormalizeMode, bool Modulated>
+bool UDShaper::skipChunk(const iplug::sample* inputL, const iplug::sample* inputR, iplug::sample* outputL, iplug::sample* outputR, int n, const CompiledCurve& curve1, const CompiledCurve& curve2, int& clockLag)
+{
+  bool constant = isConstant(inputL, n) && isConstant(inputR, n);
+  bool silent = constant && (inputL[0] == 0.) && (inputR[0] == 0.);
+
+  if constexpr (Normalize && (NormalizeMode == normalizeLookahead))
+  {
+    // The delay line must only hold zeros, with no POIs left to pass, and the normalizers
+    // must map zero to zero. Then the output is silent and the buffers do not change.
+    bool isDrained = (mSilentSamples >= mNormalizeLatency) && (mBufferL.size() == mNormalizeLatency);
+    bool isSteady = (mPOIsL.offsets.size() <= 1) && (mPOIsR.offsets.size() <= 1) && (mNormL.normalize(0.) == 0.) && (mNormR.normalize(0.) == 0.);
+    mSilentSamples = silent ? std::min(mSilentSamples + n, mNormalizeLatency) : 0;
+    if (!silent || !isDrained || !isSteady)
+    {
+      return false;
+    }
+
+    // Advance the POI state as if n zeros had been pushed to and popped from the buffers.
+    mPOIsL.advanceSilence(n, mNormalizeLatency);
+    mPOIsR.advanceSilence(n, mNormalizeLatency);
+  }
+  else if constexpr (Normalize)
+  {
+    // The predicted POIs change on every sample, even on silence.
+    return false;
+  }
+  else if constexpr (!Modulated)
+  {
+    // Equal inputs give equal outputs, so only the first sample is processed.
+    if (!constant || (n == 1))
+    {
+      return false;
     }
+    processChunk<Mode, Normalize, NormalizeMode, Modulated>(inputL, inputR, outputL, outputR, 1, curve1, curve2, clockLag);
+    std::fill(outputL + 1, outputL + n, outputL[0]);
+    std::fill(outputR + 1, outputR + n, outputR[0]);
+    return true;
+  }
+  else
+  {
+    // In up/down mode, the first zero can change the direction.
+    bool isSettled = (Mode != upDown) || ((mFrontSampleL.previousLevel == 0.) && (mFrontSampleR.previousLevel == 0.));
+    if (!silent || !isSettled)
+    {
+      return false;
+    }
+  }
+
+  // The shaping functions map zero to zero, even while modulated. The modulation restarts
+  // at the next sample that is processed, with the LFO clock advanced past the silence.
+  if constexpr (Modulated)
+  {
+    clockLag += n;
+    mModulationActive = false;
   }
+  std::fill(outputL, outputL + n, 0.);
+  std::fill(outputR, outputR + n, 0.);
+  return true;
 }
-#endif
 
-void UDShaper::OnParamChange(int idx)
+template <distortionMode Mode, bool Normalize, normalizationMode NormalizeMode, bool Modulated>
+void UDShaper::processChunk(const iplug::sample* inputL, const iplug::sample* inputR, iplug::sample* outputL, iplug::sample* outputR, int n, const CompiledCurve& curve1, const CompiledCurve& curve2, int& clockLag)
 {
-  if (idx < EParams::kNumParams)
+  if (skipChunk<Mode, Normalize, NormalizeMode, Modulated>(inputL, inputR, outputL, outputR, n, curve1, curve2, clockLag))
+  {
+    return;
+  }
+
+  prepareChunk<Mode, Normalize, NormalizeMode>(inputL, inputR, n);
+
+  if constexpr (Modulated)
+  {
+    shapeChunkModulated<Normalize>(curve1, curve2, n, clockLag);
+  }
+  else
+  {
+    shapeChunk<Normalize>(curve1, curve2, n);
+  }
+
+  finishChunk<Mode>(outputL, outputR, n);
+}
+
+// The processChunk specializations are stored in a table with the index
+// ((distortionMode * 3) + normalization) * 2 + modulated,
+// where normalization is 0 if off, 1 for normalizeLookahead and 2 for normalizePredictive.
+constexpr int NUMBER_DISTORTION_MODES = 4;
+
+template <int Index>
+constexpr UDShaper::ChunkProcessor chunkProcessor()
+{
+  constexpr distortionMode mode = static_cast<distortionMode>(Index / 6);
+  constexpr int normalization = (Index / 2) % 3;
+  constexpr normalizationMode normalizeMode = (normalization == 2) ? normalizePredictive : normalizeLookahead;
+  return &UDShaper::processChunk<mode, (normalization != 0), normalizeMode, (Index % 2 == 1)>;
+}
+
+template <int... Indices>
+constexpr std::array<UDShaper::ChunkProcessor, sizeof...(Indices)> makeChunkProcessors(std::integer_sequence<int, Indices...>)
+{
+  return {chunkProcessor<Indices>()...};
+}
+
+static constexpr auto chunkProcessors = makeChunkProcessors(std::make_integer_sequence<int, NUMBER_DISTORTION_MODES * 3 * 2>());
+
+UDShaper::ChunkProcessor UDShaper::selectChunkProcessor(bool isModulated) const
+{
+  int normalization = mNormalize ? 1 + static_cast<int>(mNormalizeMode) : 0;
+  return chunkProcessors[(static_cast<int>(mMode) * 3 + normalization) * 2 + (isModulated ? 1 : 0)];
+}
+
+void UDShaper::updateTransport(int nFrames)
+{
+  // Where the previous block ended if the host kept playing.
+  double expectedPosition = mTransport.getBeatPosition(mTransportSamples);
+  bool wasPlaying = mTransport.isPlaying;
+
+  mTransport.sampleRate = GetSampleRate();
+  mTransport.tempo = GetTempo();
+  mTransport.beatPosition = GetPPQPos();
+  mTransport.secondsPlayed = GetSamplePos() / mTransport.sampleRate;
+  mTransport.secondsPerSample = 1. / mTransport.sampleRate;
+  mTransport.beatsPerSample = mTransport.tempo / 60. * mTransport.secondsPerSample;
+  mTransport.isPlaying = GetTransportIsRunning();
+  mTransport.isLooping = mTimeInfo.mTransportLoopEnabled;
+  mTransport.loopStart = mTimeInfo.mCycleStart;
+  mTransport.loopEnd = mTimeInfo.mCycleEnd;
+  mTransport.isJump = mTransport.isPlaying && (!wasPlaying || (std::abs(mTransport.beatPosition - expectedPosition) > LFO_CLOCK_TOLERANCE));
+
+  // While stopped, the position does not advance.
+  mTransportSamples = mTransport.isPlaying ? nFrames : 0;
+}
+
+void UDShaper::ProcessBlock(sample** inputs, sample** outputs, int nFrames)
+{
+  // Decaying tails, fades and small modulation amplitudes produce subnormals.
+  ScopedFlushDenormals flushDenormals;
+
+  applyFlaggedParamChanges();
+
+  // The host transport is queried once per block.
+  updateTransport(nFrames);
+  bool isPlaying = mTransport.isPlaying;
+
+  // The shaping functions are evaluated on their flat representation, which
+  // avoids touching the UI data of the ShapePoints on the audio thread.
+  // The UI thread publishes a new snapshot after every edit, which is picked up once per block.
+  const CompiledCurve& curve1 = shapeEditor1.acquireCompiledCurve();
+  const CompiledCurve& curve2 = shapeEditor2.acquireCompiledCurve();
+
+  // Shaping functions only change over time if the host is playing and a shaping
+  // function is connected to an LFO. Else the functions are constant and can be
+  // evaluated on whole chunks.
+  bool isModulated = isPlaying && (curve1.isModulated() || curve2.isModulated());
+
+  // After a jump, the functions of the previous tick belong to a different position.
+  if (!isModulated || mTransport.isJump)
   {
-    if (idx == EParams::distMode)
+    mModulationActive = false;
+  }
+  if (isModulated)
+  {
+    // Continue the LFO phases from the previous block unless the host position jumped.
+    LFOs.syncClock(mLFOClock, mTransport);
+  }
+
+  // The number of samples mLFOClock lags behind the current sample.
+  int clockLag = 0;
+
+  // Split the block at the sample-accurate parameter changes.
+  int eventIdx = 0;
+  for (int start = 0; start < nFrames;)
+  {
+    while ((eventIdx < mNumParamEvents) && (mParamEvents[eventIdx].sampleOffset <= start))
     {
-      mMode = static_cast<distortionMode>(GetParam(idx)->Value());
+      applyParamChange(mParamEvents[eventIdx].paramIdx, mParamEvents[eventIdx].value);
+      eventIdx++;
     }
-    if (idx == EParams::normalize)
+    int end = (eventIdx < mNumParamEvents) ? std::min(mParamEvents[eventIdx].sampleOffset, nFrames) : nFrames;
+
+    // The parameters are constant within the sub-block, so the specialization is selected once.
+    ChunkProcessor processor = selectChunkProcessor(isModulated);
+
+    for (int offset = start; offset < end; offset += PROCESS_CHUNK_SIZE)
     {
-      mNormalize = GetParam(idx)->Value();
+      int n = std::min(PROCESS_CHUNK_SIZE, end - offset);
+      (this->*processor)(inputs[0] + offset, inputs[1] + offset, outputs[0] + offset, outputs[1] + offset, n, curve1, curve2, clockLag);
+    }
+    start = end;
+  }
 
-      if (mNormalize)
-      {
-        SetLatency(LATENCY_NORMALIZE);
-      }
-      else
+  // Changes beyond the end of the block.
+  for (; eventIdx < mNumParamEvents; eventIdx++)
+  {
+    applyParamChange(mParamEvents[eventIdx].paramIdx, mParamEvents[eventIdx].value);
+  }
+  mNumParamEvents = 0;
+
+  // The clock must be at the start of the next block to detect jumps.
+  if (isModulated)
+  {
+    mLFOClock.advance(clockLag);
+  }
+}
+#endif
+
+void UDShaper::OnParamChange(int idx, EParamSource source, int sampleOffset)
+{
+#if IPLUG_DSP
+  if (isProcessingParam(idx))
+  {
+    // Hosts deliver sample-accurate changes on the audio thread right before ProcessBlock.
+    // They are inserted behind all events at the same or an earlier sample.
+    if ((sampleOffset >= 0) && (mNumParamEvents < PARAM_EVENT_CAPACITY))
+    {
+      int i = mNumParamEvents;
+      while ((i > 0) && (mParamEvents[i - 1].sampleOffset > sampleOffset))
       {
-        SetLatency(0);
-        clearBuffer();
+        mParamEvents[i] = mParamEvents[i - 1];
+        i--;
       }
+      mParamEvents[i] = {idx, GetParam(idx)->Value(), sampleOffset};
+      mNumParamEvents++;
+    }
+
+    // Changes from other threads are applied at the start of the next block.
+    else
+    {
+      mParamChanged[idx] = true;
+      mAnyParamChanged = true;
+    }
+
+    // The host must not be informed about a new latency from the audio thread.
+    if ((idx == EParams::normalize) || (idx == EParams::normalizeFrequency) || (idx == EParams::normalizeMode))
+    {
+      mLatencyChanged = true;
     }
+  }
+#endif
+
+  OnParamChange(idx);
+}
+
+void UDShaper::OnParamChange(int idx)
+{
+  if (idx < EParams::kNumParams)
+  {
     if (idx == activeLFOIdx)
     {
       int newLFOIdx = GetParam(idx)->Value();
@@ -448,12 +897,6 @@ void UDShaper::OnParamChange(int idx)
         LFOs.setFrequencyValue(LFOLoopMode::LFOFrequencySeconds, GetParam(idx)->Value());
       }
     }
-
-    // Udpade the internal modulation amount state if a link knob has been changed.
-    else if (idx >= EParams::modStart)
-    {
-      modulationAmounts[idx - EParams::modStart] = GetParam(idx)->Value();
-    }
   }
 }
 
@@ -513,6 +956,22 @@ bool UDShaper::OnMessage(int msgTag, int ctrlTag, int dataSize, const void* pDat
 
 void UDShaper::OnIdle()
 {
+  // Bake LFO curves that have been edited since the last call.
+  LFOs.refreshWavetables();
+
+  // Build the lookup tables of shaping functions that have been edited without a mouse drag,
+  // e.g. through a popup menu or a modulation link.
+  shapeEditor1.refreshLookupTable();
+  shapeEditor2.refreshLookupTable();
+
+#if IPLUG_DSP
+  // Report the latency of the parameter changes since the last call.
+  if (mLatencyChanged.exchange(false))
+  {
+    reportLatency();
+  }
+#endif
+
   // Refresh the UI modulation amplitudes used for rendering.
   const double beatPosition = GetPPQPos();
   const double secondsPlayed = GetSamplePos() / GetSampleRate();
@@ -525,10 +984,13 @@ void UDShaper::OnIdle()
 
 void UDShaper::OnReset()
 {
-  clearBuffer();
+  // The lookahead is defined in time, so the buffers depend on the sample rate.
+  allocateBuffers();
+  updateNormalizeLatency();
+  reportLatency();
 
-  mPOIOffsetCountL = 0;
-  mPOIOffsetCountR = 0;
+  mModulationActive = false;
+  mLFOClock.isSynced = false;
 }
 
 bool UDShaper::SerializeState(IByteChunk& chunk) const
@@ -557,10 +1019,7 @@ int UDShaper::UnserializeState(const IByteChunk& chunk, int startPos)
   shapeEditor1.getLinks(activeLinks);
   shapeEditor2.getLinks(activeLinks);
 
-  for (int link : activeLinks)
-  {
-    LFOs.setLinkActive(link);
-  }
+  LFOs.setLinksActive(activeLinks);
 
   startPos = UnserializeParams(chunk, startPos);
 
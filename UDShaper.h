@@ -1,8 +1,9 @@
 #pragma once
 
-#include <queue>
-#include <deque>
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <utility>
 #include "IPlug_include_in_plug_hdr.h"
 #include "src/color_palette.h"
 #include "src/string_presets.h"
@@ -11,6 +12,8 @@
 #include "src/UDShaperElements/LFOController.h"
 #include "src/UDShaperParameters.h"
 #include "src/controlMessageTags.h"
+#include "src/ringBuffer.h"
+#include "src/normalization.h"
 
 const int kNumPresets = 1;
 
@@ -32,6 +35,12 @@ class UDShaper final : public Plugin
   // Apply piecewise normalization before audio processing.
   bool mNormalize = true;
 
+  // Number of samples between two evaluations of the LFOs.
+  int mModulationInterval = MODULATION_RATES[0];
+
+  // Interpolation of the shaping functions between two evaluations of the LFOs.
+  modulationSmoothing mModulationSmoothing = smoothingLinear;
+
   // Array holding the amplitudes of all LFO modulation links. See src/LFOController.h.
   // Is updated on the UI thread and provides modulation amplitudes for IControls.
   double modulationAmplitudesUI[MAX_NUMBER_LFOS * MAX_MODULATION_LINKS] = {};
@@ -41,9 +50,17 @@ class UDShaper final : public Plugin
   // Supposed to avoid frequent GetParam calls on the audio thread.
   double modulationAmounts[MAX_NUMBER_LFOS * MAX_MODULATION_LINKS] = {};
 
+  // Array holding the amplitudes of all LFO modulation links on the audio thread.
+  // Only the slots of active links are written, the others are zero, see LFOController::getModulationAmplitudes.
+  double mModulationAmplitudes[MAX_NUMBER_LFOS * MAX_MODULATION_LINKS] = {};
+
 public:
   UDShaper(const InstanceInfo& info);
 
+  // Queues changes of parameters that affect the audio processing, see applyParamChange.
+  void OnParamChange(int paramIdx, EParamSource source, int sampleOffset) override;
+
+  // Handles changes of parameters that only affect the UI.
   void OnParamChange(int paramIdx) override;
   bool OnMessage(int msgTag, int ctrlTag, int dataSize, const void* pData) override;
   void OnIdle() override;
@@ -58,89 +75,18 @@ public:
   // - the input audio is currently positive or negative
   // for every sample going in and out of the buffer.
   // Samples where one of these states change are referred to as 'points of
-  // interest' (POIs).
+  // interest' (POIs). See src/normalization.h.
 
-  // Stores two POI levels and normalizes samples to their interval.
-  // 'points of interest' (POIs) are samples that are either minima, maxima or
-  // zero points.
-  struct POINormalizer
-  {
-    // Set the value of the next POI.
-    void setNextLevel(iplug::sample newLevel)
-    {
-      levelPrev = levelNext;
-      levelNext = newLevel;
-
-      increasing = levelPrev < levelNext;
-
-      range = levelNext - levelPrev;
-      range = (range > 0) ? range : -range;
-
-      iplug::sample absolutePrev = (levelPrev > 0) ? levelPrev : -levelPrev;
-      iplug::sample absoluteNext = (levelNext > 0) ? levelNext : -levelNext;
-      offset = (absolutePrev < absoluteNext) ? levelPrev : levelNext;
-    }
-
-    // Normalize a sample to the current POI range. The sign is preserved,
-    // i.e. ouput is either in [-1, 0] or [0, 1].
-    // * @param input Input value, should be within the current POI range
-    // * @return The value of the input sample normalized to the POI range
-    iplug::sample normalize(iplug::sample input) const
-    {
-      if (range == 0.)
-      {
-        return input;
-      }
-      return (input - offset) / range;
-    }
-
-    // * @param input Sample normalized to [0, 1] or [-1, 0]
-    // * @return The value of a normalized sample scaled back to the POI range
-    iplug::sample revertNormalize(iplug::sample input) const
-    {
-      if (range == 0.)
-      {
-        return input;
-      }
-      return input * range + offset;
-    }
-
-    bool isIncreasing() const
-    {
-      return increasing;
-    }
-
-  private:
-    iplug::sample levelPrev = 0.;
-    iplug::sample levelNext = 0.;
-    iplug::sample range = 0.;
-    iplug::sample offset = 0.;
-    bool increasing = false;
-  };
-
-  // Stores information regarding the state of a single sample.
-  // Contains flags to indicate if the sample is on a positive segment of
-  // audio, if the audio is increasing at this sample and the level of the
-  // previous sample.
-  struct SampleState
-  {
-    // Indicates if the sample is on a positive segment. This can be true
-    // even if the audio is zero, in which case it means that the previous
-    // samples were all >= zero. This must be tracked to correctly detect
-    // points at which the sign changes.
-    bool isPositive = false;
-
-    bool isIncreasing = false;
-    iplug::sample previousLevel = 0.;
-  };
+  // The audio and POI buffers are allocated by allocateBuffers and never allocate
+  // on the audio thread.
 
   // Audio buffer for the left channel.
   // If mid/side mode is active, this represents the mid-channel.
-  std::queue<iplug::sample> mBufferL;
+  RingBuffer<iplug::sample> mBufferL;
 
   // Audio buffer for the right channel.
   // If mid/side mode is active, this represents the side-channel.
-  std::queue<iplug::sample> mBufferR;
+  RingBuffer<iplug::sample> mBufferR;
 
   // POINormalizer for the left channel.
   POINormalizer mNormL;
@@ -152,42 +98,221 @@ public:
   SampleState mFrontSampleL;
   SampleState mFrontSampleR;
 
-  // State of the sample at the back of the buffer.
-  SampleState mBackSampleL;
-  SampleState mBackSampleR;
+  // POIs in the buffers and the state at the back of the buffers.
+  POIQueue mPOIsL;
+  POIQueue mPOIsR;
 
-  // The position of points of interest in the audio buffer
-  // (left channel).
-  // Each entry corresponds to one POI and gives the relative
-  // offset in samples from the previous POI.
-  std::deque<int> mPOIOffsetL;
+  // Samples of the current chunk loaded to the back of the buffers (after the mid/side transform).
+  iplug::sample mBackChunkL[PROCESS_CHUNK_SIZE] = {};
+  iplug::sample mBackChunkR[PROCESS_CHUNK_SIZE] = {};
+
+  // Lookahead of the piecewise normalization in samples, see updateNormalizeLatency.
+  int mNormalizeLatency = 0;
+
+  // Strategy of the piecewise normalization.
+  normalizationMode mNormalizeMode = normalizeLookahead;
+
+  // Predicts the POIs of each channel in normalizePredictive mode.
+  POIPredictor mPredictorL;
+  POIPredictor mPredictorR;
+
+  // Per-sample decay of the extrema tracked by the POIPredictors, see NORMALIZE_PREDICTOR_RELEASE.
+  iplug::sample mPredictorDecay = 1.;
+
+  // The number of consecutive zero samples loaded to the buffers, up to mNormalizeLatency.
+  // Counted per chunk, see skipChunk.
+  int mSilentSamples = 0;
+
+  // Minimum distance of the audio from the last extremum or from zero before a
+  // change in direction or sign is detected as a POI. Suppresses POIs on noise.
+  iplug::sample mPOIHysteresis = 0.;
+
+  // ----- chunk processing attributes -----
+  // ProcessBlock splits the host buffer into chunks of PROCESS_CHUNK_SIZE samples
+  // and processes each chunk in three passes:
+  //  1. prepareChunk: POI tracking and direction tracking
+  //  2. evaluation of the shaping functions, normalizing the inputs and reverting the outputs
+  //  3. finishChunk: write the output
+  // The following arrays pass the intermediate results between the passes.
+
+  // Inputs of the shaping functions before normalization (left or mid channel, right or side channel).
+  iplug::sample mShapeInL[PROCESS_CHUNK_SIZE] = {};
+  iplug::sample mShapeInR[PROCESS_CHUNK_SIZE] = {};
+
+  // Outputs of the shaping functions.
+  iplug::sample mShapeOutL[PROCESS_CHUNK_SIZE] = {};
+  iplug::sample mShapeOutR[PROCESS_CHUNK_SIZE] = {};
+
+  // Samples of one channel partitioned by shaping function and their indices in the
+  // chunk, used when a chunk needs both functions.
+  iplug::sample mPartitioned[PROCESS_CHUNK_SIZE] = {};
+  int mPartitionOrder[PROCESS_CHUNK_SIZE] = {};
+
+  // true if a sample must be processed by shapeEditor1, false for shapeEditor2.
+  bool mUseCurve1L[PROCESS_CHUNK_SIZE] = {};
+  bool mUseCurve1R[PROCESS_CHUNK_SIZE] = {};
+
+  // ----- modulation attributes -----
+  // While the host is playing and a shaping function is modulated, the LFOs are
+  // evaluated every mModulationInterval samples ("ticks"). At each tick, the shaping
+  // functions are resolved at the time of the next tick. In between, the output is
+  // crossfaded from the functions of the previous tick to the next.
+
+  // Shaping functions at the modulation amplitudes of the next tick.
+  ResolvedCurve mResolved1;
+  ResolvedCurve mResolved2;
+
+  // Shaping functions at the modulation amplitudes of the previous tick.
+  ResolvedCurve mResolvedPrevious1;
+  ResolvedCurve mResolvedPrevious2;
+
+  // The number of samples processed since the last tick.
+  int mModulationCounter = 0;
+
+  // Phases of the LFOs at the last tick.
+  LFOClock mLFOClock;
+
+  // Host transport at the start of the current block.
+  TransportContext mTransport;
+
+  // The number of samples the host position advanced by in the previous block.
+  int mTransportSamples = 0;
+
+  // Fills mTransport from the host time info. Must be called once at the start of every block.
+  // * @param nFrames The number of samples in the block
+  void updateTransport(int nFrames);
+
+  // false if the previous sample has not been processed with modulation, in which
+  // case there is no previous tick to interpolate from.
+  bool mModulationActive = false;
+
+  // Segment search cursors of both shaping functions for each channel.
+  // The hit and miss counters show how often the segment search could be skipped.
+  CurveCursor mCursor1L;
+  CurveCursor mCursor1R;
+  CurveCursor mCursor2L;
+  CurveCursor mCursor2R;
+
+  // State of the POINormalizers at each sample, used to normalize the inputs of the
+  // shaping functions and to revert their outputs.
+  POINormalizer mChunkNormL[PROCESS_CHUNK_SIZE];
+  POINormalizer mChunkNormR[PROCESS_CHUNK_SIZE];
+
+  // The chunk processing is specialized at compile time for the distortion mode, the
+  // normalization and the modulation, which are constant within a block. NormalizeMode
+  // is ignored if Normalize is false.
+
+  // Loads n input samples, updates the normalizers if normalization is active and determines which
+  // shaping function each sample belongs to.
+  // Fills mShapeInL/R, mUseCurve1L/R and mChunkNormL/R.
+  template <distortionMode Mode, bool Normalize, normalizationMode NormalizeMode>
+  void prepareChunk(const iplug::sample* inputL, const iplug::sample* inputR, int n);
+
+  // Evaluates the shaping functions on the prepared chunk without modulation.
+  // Fills mShapeOutL/R.
+  template <bool Normalize>
+  void shapeChunk(const CompiledCurve& curve1, const CompiledCurve& curve2, int n);
+
+  // Evaluates the modulated shaping functions on the prepared chunk, resolving them at every tick.
+  // Fills mShapeOutL/R.
+  // * @param clockLag The number of samples mLFOClock lags behind the first sample of the chunk
+  template <bool Normalize>
+  void shapeChunkModulated(const CompiledCurve& curve1, const CompiledCurve& curve2, int n, int& clockLag);
+
+  // Transforms back from mid/side if necessary and writes
+  // n samples to the outputs.
+  template <distortionMode Mode>
+  void finishChunk(iplug::sample* outputL, iplug::sample* outputR, int n);
+
+  // Handles chunks whose output is known without evaluating the shaping functions:
+  // silence once the normalization delay line has drained, and constant input without
+  // normalization and modulation. Advances the normalization state and the LFO clock.
+  // Same parameters as processChunk.
+  // * @return false if the chunk must be processed normally
+  template <distortionMode Mode, bool Normalize, normalizationMode NormalizeMode, bool Modulated>
+  bool skipChunk(const iplug::sample* inputL, const iplug::sample* inputR, iplug::sample* outputL, iplug::sample* outputR, int n, const CompiledCurve& curve1, const CompiledCurve& curve2, int& clockLag);
+
+  // Processes a chunk of n <= PROCESS_CHUNK_SIZE samples with all three passes.
+  template <distortionMode Mode, bool Normalize, normalizationMode NormalizeMode, bool Modulated>
+  void processChunk(const iplug::sample* inputL, const iplug::sample* inputR, iplug::sample* outputL, iplug::sample* outputR, int n, const CompiledCurve& curve1, const CompiledCurve& curve2, int& clockLag);
+
+  // Pointer to a specialization of processChunk.
+  using ChunkProcessor = void (UDShaper::*)(const iplug::sample*, const iplug::sample*, iplug::sample*, iplug::sample*, int, const CompiledCurve&, const CompiledCurve&, int&);
+
+  // * @return The specialization of processChunk for the current parameters
+  ChunkProcessor selectChunkProcessor(bool isModulated) const;
+
+  // Evaluates the LFOs at the time of the next tick and resolves the shaping functions
+  // at the resulting modulation amplitudes. mLFOClock must be at the current sample.
+  void modulationTick(const CompiledCurve& curve1, const CompiledCurve& curve2);
+
+  // Evaluates the modulated shaping function on a sample, crossfading between the
+  // previous and next tick.
+  // * @param weight Weight of the next tick
+  iplug::sample shapeModulated(bool useCurve1, iplug::sample input, CurveCursor& cursor1, CurveCursor& cursor2, float weight) const;
 
-  // The position of points of interest in the audio buffer
-  // (right channel).
-  // Each entry corresponds to one POI and gives the relative
-  // offset in samples from the previous POI.
-  std::deque<int> mPOIOffsetR;
+  void ProcessBlock(iplug::sample** inputs, iplug::sample** outputs, int nFrames) override;
 
-  // The level of samples at POIs in the buffer (left channel).
-  std::deque<iplug::sample> mPOILevelL;
+  // Clears all audio and POI buffers.
+  void clearBuffer();
 
-  // The level of samples at POIs in the buffer (right channel).
-  std::deque<iplug::sample> mPOILevelR;
+  // Allocates the audio and POI buffers for the longest lookahead at the current sample
+  // rate and clears them. Must not be called while ProcessBlock is running.
+  void allocateBuffers();
 
-  // The number of samples passed since the last POI on the left
-  // channel has been found.
-  int mPOIOffsetCountL = 0;
+  // * @param frequency Lowest frequency covered by the lookahead
+  // * @return The lookahead in samples at the current sample rate, limited to the buffer capacity
+  int getLookahead(double frequency) const;
 
-  // The number of samples passed since the last POI on the right
-  // channel has been found.
-  int mPOIOffsetCountR = 0;
+  // Sets mNormalizeLatency and mPredictorDecay from mNormalizeFrequency and the
+  // sample rate and clears the buffers.
+  void updateNormalizeLatency();
 
-  // Updates the modulation amplitudes and increases the beatPosition and seconds by one sample.
-  void modulationStep(double (&modulationAmplitudes)[MAX_NUMBER_LFOS * MAX_MODULATION_LINKS] , double& beatPosition, double& seconds);
+  // Reports the latency of the current parameter values to the host. The latency is zero
+  // unless normalization is active in normalizeLookahead mode.
+  void reportLatency();
 
-  void ProcessBlock(iplug::sample** inputs, iplug::sample** outputs, int nFrames) override;
+  // true if a parameter that affects the latency has changed. OnParamChange may be called on
+  // the audio thread, so the latency is reported from OnIdle.
+  std::atomic<bool> mLatencyChanged{false};
+
+  // ----- parameter event attributes -----
+  // Parameters that affect the audio processing are only applied on the audio thread, which
+  // also owns the buffers. Changes that the host delivers with a sample offset are applied at
+  // that sample by splitting the block into sub-blocks. All other changes are applied at the
+  // start of the next block.
+
+  // A parameter change at a sample of the current block.
+  struct ParamEvent
+  {
+    int paramIdx;
+    double value;
+    int sampleOffset;
+  };
+
+  // Sample-accurate changes of the current block, sorted by sampleOffset.
+  // Only accessed on the audio thread.
+  ParamEvent mParamEvents[PARAM_EVENT_CAPACITY] = {};
+  int mNumParamEvents = 0;
+
+  // Flags of the parameters that have changed without a sample offset.
+  std::atomic<bool> mParamChanged[EParams::kNumParams] = {};
+
+  // true if any flag in mParamChanged has been set since the last block.
+  std::atomic<bool> mAnyParamChanged{false};
+
+  // Lowest frequency covered by the lookahead, see EParams::normalizeFrequency.
+  double mNormalizeFrequency = NORMALIZE_FREQUENCY_DEFAULT;
+
+  // * @return true if the parameter affects the audio processing and is applied by applyParamChange
+  static bool isProcessingParam(int idx);
+
+  // Applies a change of a parameter that affects the audio processing.
+  // Must be called on the audio thread or while it is not running.
+  void applyParamChange(int idx, double value);
+
+  // Applies the changes flagged in mParamChanged.
+  void applyFlaggedParamChanges();
 
-  // Clears all audio and POI buffers.
-  void clearBuffer();
 #endif
 };
@@ -0,0 +1,261 @@
+// Checks that the shaping and normalization kernels do not produce subnormal numbers.
+//
+// Arithmetic on subnormals is much slower than on normal numbers on most CPUs. A set of test
+// signals with decaying tails and very low levels is passed through the predictive
+// normalization and through the shaping power function, once normalized and once on the raw
+// samples like with normalization turned off. For each kernel, the number of subnormal and
+// non-finite intermediate values and results is counted and the processing time per sample
+// is measured, both with the default floating point mode and inside a ScopedFlushDenormals
+// guard like in UDShaper::ProcessBlock.
+//
+// Build from the repository root, e.g. with
+//   g++ -std=c++17 -O2 -I<path to iPlug2>/IPlug -Isrc performance/denormal_benchmark.cpp
+// The results are printed and written to data/data_denormals.csv, replacing the previous run.
+// Returns 1 if any subnormal or non-finite value is found inside the guard, else 0.
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "normalization.h"
+#include "simd.h"
+
+constexpr double SAMPLE_RATE = 48000.;
+constexpr int NUMBER_SAMPLES = 2 * 48000;
+
+// The peaks of the predictor need about two minutes of silence to decay from full scale to
+// the subnormal range.
+constexpr int NUMBER_SAMPLES_LONG = 150 * 48000;
+
+// Power of the shaping function, a steep curve that maps small inputs to much smaller outputs.
+constexpr float POWER = 4.f;
+constexpr double PI = 3.14159265358979323846;
+
+struct KernelResult
+{
+  int subnormals = 0;
+  int nonFinite = 0;
+  double nsPerSample = 0.;
+};
+
+// A kernel writes its results to output. If check is not nullptr, it also counts the special
+// values among its intermediate values in check.
+using Kernel = std::function<void(std::vector<double>& output, KernelResult* check)>;
+
+// Counts value in result if it is subnormal or non-finite. The value is classified by its bit
+// pattern: inside a ScopedFlushDenormals guard, std::fpclassify reports subnormals as zero.
+// Floats are classified as floats, since a subnormal float is a normal double.
+void count(double value, KernelResult& result)
+{
+  uint64_t bits = 0;
+  std::memcpy(&bits, &value, sizeof(bits));
+  uint64_t exponent = (bits >> 52) & 0x7ff;
+  uint64_t mantissa = bits & ((uint64_t(1) << 52) - 1);
+  result.subnormals += (exponent == 0) && (mantissa != 0);
+  result.nonFinite += (exponent == 0x7ff);
+}
+
+void count(float value, KernelResult& result)
+{
+  uint32_t bits = 0;
+  std::memcpy(&bits, &value, sizeof(bits));
+  uint32_t exponent = (bits >> 23) & 0xff;
+  uint32_t mantissa = bits & ((uint32_t(1) << 23) - 1);
+  result.subnormals += (exponent == 0) && (mantissa != 0);
+  result.nonFinite += (exponent == 0xff);
+}
+
+// Applies x^POWER to |x| in float, like CompiledCurve::forwardBlock, and restores the sign.
+// * @param check Optional storage for the counts of special float inputs and outputs of the power
+void shape(const std::vector<double>& input, std::vector<double>& output, KernelResult* check = nullptr)
+{
+  int n = static_cast<int>(input.size());
+  std::vector<float> x(n);
+  for (int i = 0; i < n; i++)
+  {
+    x[i] = static_cast<float>(std::abs(input[i]));
+  }
+  if (check)
+  {
+    for (float value : x)
+    {
+      count(value, *check);
+    }
+  }
+
+  int i = 0;
+#ifdef UDS_SIMD
+  std::vector<float> y(n);
+  for (; i + SIMD_WIDTH <= n; i += SIMD_WIDTH)
+  {
+    simdStore(y.data() + i, simdPow(simdLoad(x.data() + i), simdSet(POWER)));
+  }
+  for (int j = 0; j < i; j++)
+  {
+    if (check)
+    {
+      count(y[j], *check);
+    }
+    output[j] = std::copysign(static_cast<double>(y[j]), input[j]);
+  }
+#endif
+  for (; i < n; i++)
+  {
+    float y = std::pow(x[i], POWER);
+    if (check)
+    {
+      count(y, *check);
+    }
+    output[i] = std::copysign(static_cast<double>(y), input[i]);
+  }
+}
+
+// Runs a kernel, measures the time and counts the special values in its intermediate values
+// and output. The values are counted in a second run, so counting does not affect the time.
+KernelResult run(const Kernel& kernel, int n, bool flush)
+{
+  std::vector<double> output(n);
+  KernelResult result;
+
+  auto start = std::chrono::steady_clock::now();
+  if (flush)
+  {
+    ScopedFlushDenormals flushDenormals;
+    kernel(output, nullptr);
+  }
+  else
+  {
+    kernel(output, nullptr);
+  }
+  auto end = std::chrono::steady_clock::now();
+  result.nsPerSample = std::chrono::duration<double, std::nano>(end - start).count() / n;
+
+  if (flush)
+  {
+    ScopedFlushDenormals flushDenormals;
+    kernel(output, &result);
+  }
+  else
+  {
+    kernel(output, &result);
+  }
+  for (double value : output)
+  {
+    count(value, result);
+  }
+  return result;
+}
+
+// Runs all kernels on a test signal.
+// * @return The number of subnormal and non-finite values found inside the ScopedFlushDenormals guard
+int evaluate(const std::string& name, int n, const std::function<double(int)>& signal, std::ofstream& file)
+{
+  std::vector<double> input(n);
+  for (int i = 0; i < n; i++)
+  {
+    input[i] = signal(i);
+  }
+
+  // Subnormal inputs are read as zero inside the guard and are not counted as failures, but
+  // they explain subnormal results without the guard. The shaping kernels read them as floats.
+  KernelResult inputs;
+  for (double value : input)
+  {
+    count(value, inputs);
+    count(static_cast<float>(value), inputs);
+  }
+  std::cout << name << ", input: " << inputs.subnormals << " subnormal, " << inputs.nonFinite << " non-finite\n";
+
+  double decay = std::exp(-NORMALIZE_FREQUENCY_DEFAULT / (SAMPLE_RATE * NORMALIZE_PREDICTOR_RELEASE));
+  auto normalize = [&](std::vector<double>& output, KernelResult*)
+  {
+    POIPredictor predictor;
+    POINormalizer norm;
+    for (int i = 0; i < n; i++)
+    {
+      predictor.process(input[i], 0., decay, norm);
+      output[i] = norm.normalize(input[i]);
+    }
+  };
+  auto shapeNormalized = [&](std::vector<double>& output, KernelResult* check)
+  {
+    std::vector<POINormalizer> norms(n);
+    POIPredictor predictor;
+    std::vector<double> normalized(n);
+    for (int i = 0; i < n; i++)
+    {
+      predictor.process(input[i], 0., decay, norms[i]);
+      normalized[i] = norms[i].normalize(input[i]);
+    }
+    if (check)
+    {
+      for (double value : normalized)
+      {
+        count(value, *check);
+      }
+    }
+    shape(normalized, output, check);
+    for (int i = 0; i < n; i++)
+    {
+      output[i] = norms[i].revertNormalize(output[i]);
+    }
+  };
+  auto shapeRaw = [&](std::vector<double>& output, KernelResult* check) { shape(input, output, check); };
+
+  const std::vector<std::pair<std::string, Kernel>> kernels = {
+    {"normalize", normalize}, {"shape normalized", shapeNormalized}, {"shape raw", shapeRaw}};
+
+  int failures = 0;
+
+  for (const auto& kernel : kernels)
+  {
+    for (bool flush : {false, true})
+    {
+      KernelResult result = run(kernel.second, n, flush);
+      std::cout << name << ", " << kernel.first << (flush ? ", FTZ/DAZ" : ", default") << ": "
+                << result.subnormals << " subnormal, " << result.nonFinite << " non-finite, "
+                << result.nsPerSample << " ns per sample\n";
+      file << name << "," << kernel.first << "," << flush << "," << result.subnormals << ","
+           << result.nonFinite << "," << result.nsPerSample << "\n";
+
+      if (flush)
+      {
+        failures += result.subnormals + result.nonFinite;
+      }
+    }
+  }
+  return failures;
+}
+
+int main()
+{
+  std::ofstream file("performance/data/data_denormals.csv");
+  std::mt19937 generator(1);
+  std::normal_distribution<double> noise(0., 1.);
+
+  auto sine = [](double frequency, int i) { return std::sin(2 * PI * frequency * i / SAMPLE_RATE); };
+
+  int failures = 0;
+
+  // Decays by about 4300 dB within the signal, passing through the subnormal range.
+  failures += evaluate("decaying sine 100 Hz", NUMBER_SAMPLES, [&](int i) { return std::exp(-i / (0.002 * SAMPLE_RATE)) * sine(100., i); }, file);
+  failures += evaluate("sine 100 Hz -300 dB", NUMBER_SAMPLES, [&](int i) { return 1e-15 * sine(100., i); }, file);
+  failures += evaluate("noise -300 dB", NUMBER_SAMPLES, [&](int) { return 1e-15 * noise(generator); }, file);
+  failures += evaluate("fade out 1 s", NUMBER_SAMPLES, [&](int i) { return std::max(0., 1. - i / SAMPLE_RATE) * sine(100., i); }, file);
+  failures += evaluate("sine 100 Hz, then silence", NUMBER_SAMPLES_LONG, [&](int i) { return (i < SAMPLE_RATE) ? sine(100., i) : 0.; }, file);
+
+  if (failures > 0)
+  {
+    std::cout << "FAILED: " << failures << " subnormal or non-finite values inside ScopedFlushDenormals\n";
+    return 1;
+  }
+  std::cout << "No subnormal or non-finite values inside ScopedFlushDenormals\n";
+  return 0;
+}
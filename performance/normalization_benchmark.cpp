@@ -0,0 +1,136 @@
+// Compares the predictive piecewise normalization with the lookahead normalization.
+//
+// The lookahead normalization knows the POIs in advance, as long as the distance between two
+// POIs does not exceed the lookahead. Both are applied to a set of test signals and the
+// following errors of the predictive mode are measured:
+// - RMS and maximum difference of the normalized samples
+// - RMS difference of the output after a shaping function y = x * |x| has been applied to the
+//   normalized samples and the normalization has been reverted, relative to the RMS of the
+//   lookahead output in dB
+//
+// Build from the repository root, e.g. with
+//   g++ -std=c++17 -O2 -I<path to iPlug2>/IPlug -Isrc performance/normalization_benchmark.cpp
+// The results are printed and written to data/data_normalization_error.csv, replacing the
+// previous run.
+
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "normalization.h"
+
+constexpr double SAMPLE_RATE = 48000.;
+constexpr int NUMBER_SAMPLES = 2 * 48000;
+
+// Lookahead in samples at the default normalization frequency, as in UDShaper::getLookahead.
+const int LATENCY = getLookaheadSamples(SAMPLE_RATE, NORMALIZE_FREQUENCY_DEFAULT);
+constexpr double PI = 3.14159265358979323846;
+
+// Shaping function used to compare the outputs, maps [-1, 1] to [-1, 1].
+double shape(double x)
+{
+  return x * std::abs(x);
+}
+
+// Normalizes a signal like the lookahead mode of UDShaper::prepareChunk without hysteresis.
+// The signal is loaded in chunks and followed by LATENCY zeros to drain the buffer.
+void runLookahead(const std::vector<double>& input, std::vector<POINormalizer>& norms)
+{
+  int total = static_cast<int>(input.size()) + LATENCY;
+  std::vector<double> padded(input);
+  padded.resize(total, 0.);
+
+  POIQueue POIs;
+  POIs.allocate(LATENCY);
+  POINormalizer norm;
+  for (int start = 0; start < total; start += PROCESS_CHUNK_SIZE)
+  {
+    int n = std::min(PROCESS_CHUNK_SIZE, total - start);
+    POIs.detectChunk(padded.data() + start, n, 0., LATENCY);
+
+    // The front of the buffer is LATENCY samples behind the back.
+    for (int i = 0; i < n; i++)
+    {
+      int j = start + i - LATENCY;
+      if (j < 0) continue;
+
+      POIs.advanceFront(i, n, norm);
+      norms[j] = norm;
+    }
+  }
+}
+
+// Normalizes a signal with a POIPredictor.
+void runPredictive(const std::vector<double>& input, std::vector<POINormalizer>& norms)
+{
+  POIPredictor predictor;
+  POINormalizer norm;
+  double decay = std::exp(-NORMALIZE_FREQUENCY_DEFAULT / (SAMPLE_RATE * NORMALIZE_PREDICTOR_RELEASE));
+  for (int i = 0; i < static_cast<int>(input.size()); i++)
+  {
+    predictor.process(input[i], 0., decay, norm);
+    norms[i] = norm;
+  }
+}
+
+void evaluate(const std::string& name, const std::function<double(int)>& signal, std::ofstream& file)
+{
+  std::vector<double> input(NUMBER_SAMPLES);
+  for (int i = 0; i < NUMBER_SAMPLES; i++)
+  {
+    input[i] = signal(i);
+  }
+
+  std::vector<POINormalizer> lookahead(NUMBER_SAMPLES);
+  std::vector<POINormalizer> predicted(NUMBER_SAMPLES);
+  runLookahead(input, lookahead);
+  runPredictive(input, predicted);
+
+  double sumSquaredError = 0.;
+  double maxError = 0.;
+  double sumSquaredOutput = 0.;
+  double sumSquaredOutputError = 0.;
+  for (int i = 0; i < NUMBER_SAMPLES; i++)
+  {
+    double normLookahead = lookahead[i].normalize(input[i]);
+    double normPredicted = predicted[i].normalize(input[i]);
+    double error = std::abs(normPredicted - normLookahead);
+    sumSquaredError += error * error;
+    maxError = std::max(maxError, error);
+
+    double outLookahead = lookahead[i].revertNormalize(shape(normLookahead));
+    double outPredicted = predicted[i].revertNormalize(shape(normPredicted));
+    sumSquaredOutput += outLookahead * outLookahead;
+    sumSquaredOutputError += (outPredicted - outLookahead) * (outPredicted - outLookahead);
+  }
+
+  double rmsError = std::sqrt(sumSquaredError / NUMBER_SAMPLES);
+  double outputError = 10 * std::log10(sumSquaredOutputError / sumSquaredOutput);
+
+  std::cout << name << ": normalized RMS error " << rmsError << ", max error " << maxError
+            << ", output error " << outputError << " dB\n";
+  file << name << "," << rmsError << "," << maxError << "," << outputError << "\n";
+}
+
+int main()
+{
+  std::ofstream file("performance/data/data_normalization_error.csv");
+  std::mt19937 generator(1);
+  std::normal_distribution<double> noise(0., 1.);
+
+  auto sine = [](double frequency, int i) { return std::sin(2 * PI * frequency * i / SAMPLE_RATE); };
+
+  evaluate("sine 100 Hz", [&](int i) { return 0.8 * sine(100., i); }, file);
+  evaluate("sine 1 kHz", [&](int i) { return 0.8 * sine(1000., i); }, file);
+  evaluate("decaying sine 100 Hz", [&](int i) { return std::exp(-i / (0.3 * SAMPLE_RATE)) * sine(100., i); }, file);
+  evaluate("rising sine 100 Hz", [&](int i) { return std::min(1., i / SAMPLE_RATE) * sine(100., i); }, file);
+  evaluate("saw 110 Hz", [&](int i) { double p = 110. * i / SAMPLE_RATE; return 0.8 * (2 * (p - std::floor(p)) - 1); }, file);
+  evaluate("sines 100 Hz + 750 Hz", [&](int i) { return 0.5 * sine(100., i) + 0.3 * sine(750., i); }, file);
+  evaluate("sine 100 Hz + noise -40 dB", [&](int i) { return 0.8 * sine(100., i) + 0.01 * noise(generator); }, file);
+
+  return 0;
+}
@@ -77,6 +77,28 @@ void TopMenuBarLayout::setCoordinates(IRECT rect, float inGUIWidth, float inGUIH
   normalizeButtonRect.T = fullRect.T;
   normalizeButtonRect.R = normalizeButtonRect.L + GUIWidth * 0.2f;
   normalizeButtonRect.B = fullRect.B;
+
+  // The modulation rate and interpolation menus are placed right of the normalize button
+  // with their titles above them.
+  rateMenuRect.L = GUIWidth * 0.7f + 2 * FRAME_WIDTH;
+  rateMenuRect.T = fullRect.T + fullRect.H() / 2;
+  rateMenuRect.R = GUIWidth * 0.85f - FRAME_WIDTH;
+  rateMenuRect.B = fullRect.B;
+
+  rateTitleRect.L = rateMenuRect.L;
+  rateTitleRect.T = fullRect.T;
+  rateTitleRect.R = rateMenuRect.R;
+  rateTitleRect.B = rateMenuRect.T;
+
+  interpolationMenuRect.L = GUIWidth * 0.85f + FRAME_WIDTH;
+  interpolationMenuRect.T = rateMenuRect.T;
+  interpolationMenuRect.R = GUIWidth - 2 * FRAME_WIDTH;
+  interpolationMenuRect.B = fullRect.B;
+
+  interpolationTitleRect.L = interpolationMenuRect.L;
+  interpolationTitleRect.T = fullRect.T;
+  interpolationTitleRect.R = interpolationMenuRect.R;
+  interpolationTitleRect.B = interpolationMenuRect.T;
 }
 
 ShapeEditorLayout::ShapeEditorLayout(IRECT rect, float GUIWidth, float GUIHeight)
@@ -39,6 +39,10 @@ struct TopMenuBarLayout {
   IRECT modeMenuRect = IRECT();   // Box coordinates of the menu to select the distortion mode.
   IRECT menuTitleRect = IRECT();  // Box coordinates of the menu title text.
   IRECT normalizeButtonRect = IRECT();  // Box coordinates of the button used to toggle input normalization.
+  IRECT rateTitleRect = IRECT();        // Box coordinates of the modulation rate menu title text.
+  IRECT rateMenuRect = IRECT();         // Box coordinates of the menu to select the modulation rate.
+  IRECT interpolationTitleRect = IRECT(); // Box coordinates of the modulation interpolation menu title text.
+  IRECT interpolationMenuRect = IRECT();  // Box coordinates of the menu to select the modulation interpolation.
 
   TopMenuBarLayout(IRECT rect, float GUIWidth, float GUIHeight);
   void setCoordinates(IRECT rect, float GUIWidth, float GUIHeight);
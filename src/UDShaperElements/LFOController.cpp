@@ -1,5 +1,7 @@
 
 #include "LFOController.h"
+#include <cmath>
+#include <algorithm>
 
 SecondsBoxControl::SecondsBoxControl(IRECT rect, int parameterIdx)
   : IVNumberBoxControl(rect, parameterIdx, nullptr, "", DEFAULT_STYLE, false, 1., 0.05, 60., "%.2f s", false)
@@ -179,6 +181,76 @@ double FrequencyPanel::getLFOPhase(int LFOIdx, double beatPosition, double secon
   return 0.;
 }
 
+double TransportContext::getBeatPosition(int samples) const
+{
+  double position = beatPosition + samples * beatsPerSample;
+  if (isLooping && (loopEnd > loopStart) && (beatPosition < loopEnd) && (position >= loopEnd))
+  {
+    position = loopStart + std::fmod(position - loopEnd, loopEnd - loopStart);
+  }
+  return position;
+}
+
+void FrequencyPanel::syncClock(LFOClock& clock, const TransportContext& transport) const
+{
+  const double beatPosition = transport.beatPosition;
+  const double secondsPlayed = transport.secondsPlayed;
+
+  // Phases must be seeded again if the host position is not where the clock has been advanced to,
+  // e.g. after loops or seeks, and if the tempo changed.
+  bool isJump = transport.isJump || (std::abs(clock.beatPosition - beatPosition) > LFO_CLOCK_TOLERANCE) || (std::abs(clock.secondsPlayed - secondsPlayed) > LFO_CLOCK_TOLERANCE);
+  bool isRateChange = (clock.tempo != transport.tempo) || (clock.sampleRate != transport.sampleRate);
+  bool resync = !clock.isSynced || isJump || isRateChange;
+
+  for (int i = 0; i < MAX_NUMBER_LFOS; i++)
+  {
+    double frequency = (currentMode[i] == LFOFrequencyTempo) ? freqTempo[i] : freqSeconds[i];
+    if (resync || (clock.mode[i] != currentMode[i]) || (clock.frequency[i] != frequency))
+    {
+      clock.mode[i] = currentMode[i];
+      clock.frequency[i] = frequency;
+      clock.phase[i] = getLFOPhase(i, beatPosition, secondsPlayed);
+
+      if (currentMode[i] == LFOFrequencyTempo)
+      {
+        // See getLFOPhase. The phase advances by speed per bar of four beats.
+        double speed = pow(2, freqTempo[i] - 6);
+        clock.increment[i] = speed / 4 * transport.beatsPerSample;
+      }
+      else
+      {
+        clock.increment[i] = transport.secondsPerSample / freqSeconds[i];
+      }
+    }
+  }
+
+  clock.beatPosition = beatPosition;
+  clock.secondsPlayed = secondsPlayed;
+  clock.tempo = transport.tempo;
+  clock.sampleRate = transport.sampleRate;
+  clock.beatsPerSample = transport.beatsPerSample;
+  clock.secondsPerSample = transport.secondsPerSample;
+  clock.isSynced = true;
+}
+
+void LFOClock::advance(int samples)
+{
+  for (int i = 0; i < MAX_NUMBER_LFOS; i++)
+  {
+    phase[i] += samples * increment[i];
+    phase[i] -= std::floor(phase[i]);
+  }
+
+  beatPosition += samples * beatsPerSample;
+  secondsPlayed += samples * secondsPerSample;
+}
+
+double LFOClock::getPhase(int LFOIdx, int offset) const
+{
+  double p = phase[LFOIdx] + offset * increment[LFOIdx];
+  return p - std::floor(p);
+}
+
 void FrequencyPanel::refreshInternalState()
 {
   // Copy the parameter values concerning the FrequencyPanel into the arrays.
@@ -545,6 +617,55 @@ LFOController::LFOController(IRECT rect, float GUIWidth, float GUIHeight, IPlugi
     // Assign the index -1 to ShapeEditors that act as LFO editors.
     editors.emplace_back(layout.editorFullRect, GUIWidth, GUIHeight, -1);
   }
+
+  refreshWavetables();
+}
+
+void LFOController::refreshWavetables()
+{
+  bool isChanged = false;
+  for (int i = 0; i < MAX_NUMBER_LFOS; i++)
+  {
+    const CompiledCurve& curve = editors.at(i).getCompiledCurve();
+    if (curve.revision == wavetableRevision[i]) continue;
+    wavetableRevision[i] = curve.revision;
+    isChanged = true;
+
+    float* table = wavetablesUI.data() + i * (LFO_WAVETABLE_SIZE + 1);
+
+    // Every entry is the average of the curve over the interval around it. This smooths
+    // corners and the jump at the end of the period, which would alias at high LFO frequencies.
+    for (int j = 0; j < LFO_WAVETABLE_SIZE; j++)
+    {
+      float sum = 0.f;
+      for (int k = 0; k < LFO_WAVETABLE_OVERSAMPLING; k++)
+      {
+        double phase = (j + (k + 0.5) / LFO_WAVETABLE_OVERSAMPLING - 0.5) / LFO_WAVETABLE_SIZE;
+        sum += curve.forward(static_cast<float>(phase - std::floor(phase)));
+      }
+      table[j] = sum / LFO_WAVETABLE_OVERSAMPLING;
+    }
+    table[LFO_WAVETABLE_SIZE] = table[0];
+  }
+
+  if (!isChanged) return;
+
+  // The audio thread may still read the previously published tables, so the copy goes
+  // into the back buffer.
+  std::vector<float>& back = wavetables.getBack();
+  std::copy(wavetablesUI.begin(), wavetablesUI.end(), back.begin());
+  wavetables.publish();
+}
+
+float LFOController::readWavetable(const float* tables, int LFOIdx, double phase)
+{
+  const float* table = tables + LFOIdx * (LFO_WAVETABLE_SIZE + 1);
+
+  double pos = phase * LFO_WAVETABLE_SIZE;
+  int idx = std::min(static_cast<int>(pos), LFO_WAVETABLE_SIZE - 1);
+  float t = static_cast<float>(pos - idx);
+
+  return table[idx] + t * (table[idx + 1] - table[idx]);
 }
 
 void LFOController::attachUI(IGraphics* pGraphics)
@@ -633,27 +754,90 @@ void LFOController::refreshInternalState()
   frequencyPanel.refreshInternalState();
 }
 
-void LFOController::getModulationAmplitudes(double beatPosition, double secondsPlayed, double* amplitudes, double* factors) const
+void LFOController::syncClock(LFOClock& clock, const TransportContext& transport) const
 {
-  for (int i = 0; i < MAX_NUMBER_LFOS; i++)
+  frequencyPanel.syncClock(clock, transport);
+}
+
+void LFOController::getModulationAmplitudes(const LFOClock& clock, int offset, double* amplitudes, double* factors)
+{
+  const ModulationRouting& r = routing.acquire();
+  const float* tables = wavetables.acquire().data();
+  clearAmplitudes(r, amplitudesRevisionAudio, amplitudes);
+
+  // Every LFO in the routing has at least one active link and is evaluated once.
+  for (int n = 0; n < r.numLFOs; n++)
   {
-    double LFOAmplitude = 0;
+    int i = r.LFOs[n];
+    double LFOAmplitude = readWavetable(tables, i, clock.getPhase(i, offset));
 
-    for (int j = 0; j < MAX_MODULATION_LINKS; j++)
+    for (int k = r.linkOffsets[n]; k < r.linkOffsets[n + 1]; k++)
+    {
+      int link = r.links[k];
+      amplitudes[link] = LFOAmplitude * factors[link];
+    }
+  }
+}
+
+void LFOController::getModulationAmplitudes(double beatPosition, double secondsPlayed, double* amplitudes, double* factors)
+{
+  const ModulationRouting& r = routingUI;
+  clearAmplitudes(r, amplitudesRevisionUI, amplitudes);
+
+  for (int n = 0; n < r.numLFOs; n++)
+  {
+    int i = r.LFOs[n];
+    double phase = frequencyPanel.getLFOPhase(i, beatPosition, secondsPlayed);
+    double LFOAmplitude = readWavetable(wavetablesUI.data(), i, phase);
+
+    for (int k = r.linkOffsets[n]; k < r.linkOffsets[n + 1]; k++)
     {
-      double modAmount = factors[i * MAX_NUMBER_LFOS + j];
+      int link = r.links[k];
+      amplitudes[link] = LFOAmplitude * factors[link];
+    }
+  }
+}
+
+void LFOController::clearAmplitudes(const ModulationRouting& r, unsigned int& revision, double* amplitudes)
+{
+  if (r.revision == revision) return;
+  revision = r.revision;
 
-      // Evaluate this LFO editor only if
-      // - it is connected to at least one ModulatedParameter, i.e. any modAmount != 0
-      // - it has not been evaluated yet, i.e. LFOAmplitude = 0
-      if (modAmount && !LFOAmplitude)
+  // The slots of active links are written again right after this.
+  std::fill(amplitudes, amplitudes + MAX_NUMBER_LFOS * MAX_MODULATION_LINKS, 0.);
+}
+
+void LFOController::rebuildRouting()
+{
+  ModulationRouting& r = routingUI;
+  r.revision++;
+
+  r.numLFOs = 0;
+  int numLinks = 0;
+  for (int i = 0; i < MAX_NUMBER_LFOS; i++)
+  {
+    int firstLink = numLinks;
+    for (int j = 0; j < MAX_MODULATION_LINKS; j++)
+    {
+      if (linkActive[i][j])
       {
-        double phase = frequencyPanel.getLFOPhase(i, beatPosition, secondsPlayed);
-        LFOAmplitude = editors.at(i).forward(phase);
+        r.links[numLinks++] = i * MAX_MODULATION_LINKS + j;
       }
-      amplitudes[i * MAX_MODULATION_LINKS + j] = LFOAmplitude * modAmount;
+    }
+
+    if (numLinks > firstLink)
+    {
+      r.LFOs[r.numLFOs] = i;
+      r.linkOffsets[r.numLFOs] = firstLink;
+      r.numLFOs++;
     }
   }
+  r.linkOffsets[r.numLFOs] = numLinks;
+
+  // The audio thread may still read the previously published table, so the copy goes
+  // into the back buffer.
+  routing.getBack() = routingUI;
+  routing.publish();
 }
 
 void LFOController::setLinkActive(int idx, bool active)
@@ -661,6 +845,7 @@ void LFOController::setLinkActive(int idx, bool active)
   int linkIdx = idx % MAX_MODULATION_LINKS;
   int LFOIdx = (idx - linkIdx) / MAX_MODULATION_LINKS;
   linkActive[LFOIdx][linkIdx] = active;
+  rebuildRouting();
 
   if (IGraphics* ui = mPlugin->GetUI())
   {
@@ -672,10 +857,32 @@ void LFOController::setLinkActive(int idx, bool active)
       ui->GetControlWithTag(EControlTags::LFOKnobStart + 2 * linkIdx)->SetDisabled(!active);
       ui->GetControlWithTag(EControlTags::LFOKnobStart + 2 * linkIdx + 1)->SetDisabled(!active);
     }
+  }
+  refreshLinkControls();
+}
+
+void LFOController::setLinksActive(const std::set<int>& links, bool active)
+{
+  for (int idx : links)
+  {
+    int linkIdx = idx % MAX_MODULATION_LINKS;
+    int LFOIdx = (idx - linkIdx) / MAX_MODULATION_LINKS;
+    linkActive[LFOIdx][linkIdx] = active;
+  }
+  rebuildRouting();
+  refreshLinkControls();
 
+  // Enable or disable the knobs of the active LFO.
+  setActiveLFO(activeLFOIdx);
+}
+
+void LFOController::refreshLinkControls()
+{
+  if (IGraphics* ui = mPlugin->GetUI())
+  {
     // Refresh the number of displayed LFOs and make sure that the active LFO
     // is one of the displayed LFOs.
-    IControl* control = mPlugin->GetUI()->GetControlWithTag(EControlTags::LFOSelectorControlTag);
+    IControl* control = ui->GetControlWithTag(EControlTags::LFOSelectorControlTag);
     LFOSelectorControl* selectorControl = static_cast<LFOSelectorControl*>(control);
     int maxLFOIdx = selectorControl->getNumberLFOs(true) - 1;
     if (activeLFOIdx > maxLFOIdx)
@@ -726,6 +933,7 @@ int LFOController::unserializeState(const IByteChunk& chunk, int startPos, int v
     {
       startPos = editors.at(i).unserializeState(chunk, startPos, version);
     }
+    refreshWavetables();
     return startPos;
   }
 }
\ No newline at end of file
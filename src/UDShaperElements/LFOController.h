@@ -12,11 +12,13 @@
  */
 
 #include <map>
+#include <atomic>
 #include "../GUILayout.h"
 #include "../UDShaperParameters.h"
 #include "../controlTags.h"
 #include "../controlMessageTags.h"
 #include "../string_presets.h"
+#include "../tripleBuffer.h"
 #include "ShapeEditor.h"
 #include "IControls.h"
 using namespace iplug;
@@ -33,6 +35,81 @@ enum LFOLoopMode
   LFOFrequencySeconds
 };
 
+// State of the host transport at the start of an audio block.
+//
+// Filled once per block, such that all modulation consumers work with the same clock
+// and the host is not queried per sample.
+struct TransportContext
+{
+  double sampleRate = 44100.;
+
+  // Host tempo in beats per minute.
+  double tempo = 120.;
+
+  // Host position in beats and seconds at the first sample of the block.
+  double beatPosition = 0.;
+  double secondsPlayed = 0.;
+
+  // Advance of the host position per sample.
+  double beatsPerSample = 0.;
+  double secondsPerSample = 0.;
+
+  bool isPlaying = false;
+
+  // Loop range of the host in beats, only valid if isLooping is true.
+  bool isLooping = false;
+  double loopStart = 0.;
+  double loopEnd = 0.;
+
+  // true if the host position does not continue from the end of the previous block,
+  // taking a wrap at the loop end into account. Only set while playing.
+  bool isJump = false;
+
+  // * @param samples Number of samples since the first sample of the block
+  // * @return The expected host position in beats, wrapped into the loop range
+  double getBeatPosition(int samples) const;
+};
+
+// Phase accumulators of all LFOs.
+//
+// Instead of computing the phase of every LFO from the host position on every sample, the
+// phases are seeded from the host position once and then advanced by a constant increment
+// per sample. FrequencyPanel::syncClock seeds the phases again whenever the host position
+// jumps, the tempo changes or the frequency of an LFO changes.
+struct LFOClock
+{
+  // Current phase of each LFO in [0, 1).
+  double phase[MAX_NUMBER_LFOS] = {};
+
+  // Phase increment per sample of each LFO.
+  double increment[MAX_NUMBER_LFOS] = {};
+
+  // Loop mode and frequency value the increments have been computed from.
+  LFOLoopMode mode[MAX_NUMBER_LFOS] = {};
+  double frequency[MAX_NUMBER_LFOS] = {};
+
+  // Host position in beats and seconds the phases belong to.
+  double beatPosition = 0.;
+  double secondsPlayed = 0.;
+
+  // Host tempo and sample rate the increments have been computed from.
+  double tempo = 0.;
+  double sampleRate = 0.;
+
+  // Advance of the host position per sample, see TransportContext.
+  double beatsPerSample = 0.;
+  double secondsPerSample = 0.;
+
+  // false until the clock has been seeded.
+  bool isSynced = false;
+
+  // Advances all phases by the given number of samples.
+  void advance(int samples);
+
+  // * @return The phase of the LFO at LFOIdx the given number of samples ahead of the clock.
+  double getPhase(int LFOIdx, int offset = 0) const;
+};
+
 // An IVNumberBoxControl tailored to display time.
 class SecondsBoxControl : public IVNumberBoxControl
 {
@@ -166,6 +243,15 @@ public:
   // * @returns The phase of the LFO at LFOIdx
   double getLFOPhase(int LFOIdx, double beatPosition, double secondsPlayed) const;
 
+  // Prepares an LFOClock for the host position at the start of an audio block.
+  //
+  // The phases are kept if the clock has been advanced to the given position, else they
+  // are seeded from getLFOPhase. The increments are recomputed if the tempo, sample rate
+  // or the frequency of an LFO changed.
+  // * @param clock The clock to synchronize
+  // * @param transport The host transport at the start of the block
+  void syncClock(LFOClock& clock, const TransportContext& transport) const;
+
   // Refresh the state of the internally stored parameters.
   //
   // This is meant to be called after the plugin has initialized the parameters
@@ -273,6 +359,21 @@ private:
   IPopupMenu menu = IPopupMenu();
 };
 
+// Compiled list of the active modulation links, grouped by the LFO they belong to.
+//
+// The links of the n-th LFO in LFOs are links[linkOffsets[n]] to links[linkOffsets[n + 1] - 1].
+// Links are stored as indices into the array of all modulation amplitudes.
+struct ModulationRouting
+{
+  int numLFOs = 0;
+  int LFOs[MAX_NUMBER_LFOS] = {};
+  int linkOffsets[MAX_NUMBER_LFOS + 1] = {};
+  int links[MAX_NUMBER_LFOS * MAX_MODULATION_LINKS] = {};
+
+  // Incremented every time the routing is rebuilt.
+  unsigned int revision = 0;
+};
+
 // Class to access all LFO controls of the plugin.
 //
 // It holds several ShapeEditors, which are used to define a LFO curves.
@@ -302,9 +403,48 @@ class LFOController
   // within this LFO. It corresponds to the link knobs on the UI.
   bool linkActive[MAX_NUMBER_LFOS][MAX_MODULATION_LINKS] = {};
 
+  // Routing table compiled from linkActive, which is read on the UI thread. Like the wavetables,
+  // a copy is published to the audio thread.
+  ModulationRouting routingUI;
+  TripleBuffer<ModulationRouting> routing;
+
+  // Compiles linkActive into routingUI and publishes it.
+  void rebuildRouting();
+
+  // Refreshes the displayed LFOs and knobs after links have been enabled or disabled.
+  void refreshLinkControls();
+
+  // Revision of the routing the amplitudes have last been written with, on the UI thread
+  // and on the audio thread.
+  unsigned int amplitudesRevisionUI = 0;
+  unsigned int amplitudesRevisionAudio = 0;
+
+  // Zeroes all amplitudes if the routing changed since the amplitudes have last been written.
+  // Links that have been disabled keep no stale amplitude, which would be used for a moment
+  // when they are connected again, since the curves are published before the routing.
+  // * @param revision The revision the amplitudes have last been written with, updated to r
+  static void clearAmplitudes(const ModulationRouting& r, unsigned int& revision, double* amplitudes);
+
+  // Wavetables of all LFO editors, each with LFO_WAVETABLE_SIZE + 1 entries, where the last
+  // entry repeats the first. refreshWavetables bakes them into wavetablesUI, which is read on the
+  // UI thread, and publishes a copy to the audio thread.
+  std::vector<float> wavetablesUI = std::vector<float>(MAX_NUMBER_LFOS * (LFO_WAVETABLE_SIZE + 1), 0.f);
+  TripleBuffer<std::vector<float>> wavetables{std::vector<float>(MAX_NUMBER_LFOS * (LFO_WAVETABLE_SIZE + 1), 0.f)};
+
+  // Revision of the CompiledCurve each wavetable has been built from.
+  unsigned int wavetableRevision[MAX_NUMBER_LFOS] = {};
+
+  // Interpolates the wavetable of the LFO at LFOIdx at the given phase in [0, 1).
+  // * @param tables The wavetables of all LFOs, see wavetablesUI
+  static float readWavetable(const float* tables, int LFOIdx, double phase);
+
 public:
   LFOController(IRECT rect, float GUIWidth, float GUIHeight, IPluginBase* plugin);
 
+  // Rebuilds the wavetables of all LFO editors that have changed since the last call.
+  // Must not be called on the audio thread.
+  void refreshWavetables();
+
   void attachUI(IGraphics* pGraphics);
 
   // Set the loop mode.
@@ -331,18 +471,34 @@ public:
   // Each of the MAX_NUMBER_LFOS LFOs can modulate MAX_MODULATION_LINKS different parameters.
   // The input array 'amplitudes' provides storage for all possible modulation slots, regardless if
   // they have been linked to a parameter or not.
-  // If an LFO has not all available links active, the inactive links will still be reported
-  // with an amplitude of 0.
+  // Only the slots of active links are written. The slots of inactive links are zeroed once after
+  // the links have been disabled and are left untouched afterwards.
   //
   // * @param beatPosition The song position in beats at which the amplitudes are calculated
   // * @para, secondsPlayed The song position in seconds at which the amplitudes are calculated
   // * @param amplitudes Array in which the amplitudes will be copied. Must have size MAX_NUMBER_LFOS * MAX_MODULATION_LINKS
   // * @param factors Array that contains the modulation amounts corresponding to each LFO link. Must have the same size as amplitudes.
-  void getModulationAmplitudes(double beatPosition, double secondsPlayed, double* amplitudes, double* factors) const;
+  void getModulationAmplitudes(double beatPosition, double secondsPlayed, double* amplitudes, double* factors);
+
+  // Get the amplitudes of all available modulation links at the phases of an LFOClock.
+  // Must only be called on the audio thread, the overload above must only be called on the UI thread.
+  //
+  // * @param clock An LFOClock synchronized by syncClock
+  // * @param offset The number of samples ahead of the clock at which the amplitudes are calculated
+  // * @param amplitudes Array in which the amplitudes will be copied, see above
+  // * @param factors Array that contains the modulation amounts corresponding to each LFO link, see above
+  void getModulationAmplitudes(const LFOClock& clock, int offset, double* amplitudes, double* factors);
+
+  // Prepares an LFOClock for the host position at the start of an audio block. See FrequencyPanel::syncClock.
+  void syncClock(LFOClock& clock, const TransportContext& transport) const;
 
   // Enable the modulation link at idx.
   void setLinkActive(int idx, bool active = true);
 
+  // Enable or disable all modulation links in links. Equivalent to calling setLinkActive for every link,
+  // but the routing is only rebuilt once.
+  void setLinksActive(const std::set<int>& links, bool active = true);
+
   bool serializeState(IByteChunk& chunk) const;
   int unserializeState(const IByteChunk& chunk, int startPos, int version);
 };
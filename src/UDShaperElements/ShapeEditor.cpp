@@ -1,4 +1,7 @@
 #include "ShapeEditor.h"
+#include <algorithm>
+#include <limits>
+#include "../simd.h"
 
 
 // Calculate the power such that the function f: [0, 1] -> [0, 1], f(x) = x^power
@@ -29,7 +32,16 @@ bool ModulatedParameter::addModulator(int idx)
   if (!LFOIsConnected[LFOIdx])
   {
     LFOIsConnected[LFOIdx] = true;
-    modIndices.insert(idx);
+
+    // Insert idx such that modIndices stays sorted.
+    int k = numModulators;
+    while ((k > 0) && (modIndices[k - 1] > idx))
+    {
+      modIndices[k] = modIndices[k - 1];
+      k--;
+    }
+    modIndices[k] = idx;
+    numModulators++;
     return true;
   }
   else
@@ -40,12 +52,22 @@ bool ModulatedParameter::addModulator(int idx)
 
 void ModulatedParameter::getModulators(std::set<int>& mods) const
 {
-  for (int mod : modIndices)
+  for (int k = 0; k < numModulators; k++)
   {
-    mods.insert(mod);
+    mods.insert(modIndices[k]);
   }
 }
 
+int ModulatedParameter::getNumModulators() const
+{
+  return numModulators;
+}
+
+int ModulatedParameter::getModulator(int k) const
+{
+  return modIndices[k];
+}
+
 bool ModulatedParameter::isConnectedToLFO(int LFOIdx) const
 {
   return LFOIsConnected[LFOIdx];
@@ -53,15 +75,28 @@ bool ModulatedParameter::isConnectedToLFO(int LFOIdx) const
 
 bool ModulatedParameter::isConnectedToMod(int modIdx) const
 {
-  return (modIndices.find(modIdx) != modIndices.end());
+  for (int k = 0; k < numModulators; k++)
+  {
+    if (modIndices[k] == modIdx) return true;
+  }
+  return false;
 }
 
 void ModulatedParameter::removeModulator(int idx)
 {
   int LFOIdx = (idx - idx % MAX_MODULATION_LINKS) / MAX_MODULATION_LINKS;
-  if (modIndices.erase(idx))
+  for (int k = 0; k < numModulators; k++)
   {
+    if (modIndices[k] != idx) continue;
+
+    // Close the gap to keep the remaining indices contiguous and sorted.
+    for (int l = k + 1; l < numModulators; l++)
+    {
+      modIndices[l - 1] = modIndices[l];
+    }
+    numModulators--;
     LFOIsConnected[LFOIdx] = false;
+    return;
   }
 }
 
@@ -76,9 +111,9 @@ float ModulatedParameter::get(double* modulationAmplitudes) const
   float currentValue = base;
   if (modulationAmplitudes)
   {
-    for (int idx : modIndices)
+    for (int k = 0; k < numModulators; k++)
     {
-      currentValue += modulationAmplitudes[idx];
+      currentValue += modulationAmplitudes[modIndices[k]];
     }
   }
 
@@ -88,18 +123,18 @@ float ModulatedParameter::get(double* modulationAmplitudes) const
 
 bool ModulatedParameter::isModulated() const
 {
-  return modIndices.size() > 0;
+  return numModulators > 0;
 }
 
 void ModulatedParameter::serializeState(IByteChunk& chunk) const
 {
   chunk.Put(&base);
 
-  int numLinks = modIndices.size();
+  int numLinks = numModulators;
   chunk.Put(&numLinks);
-  for (int idx : modIndices)
+  for (int k = 0; k < numModulators; k++)
   {
-    chunk.Put(&idx);
+    chunk.Put(&modIndices[k]);
   }
 }
 
@@ -129,6 +164,7 @@ ShapePoint::ShapePoint(float x, float y, IRECT editorRect, float pow, float omeg
   mode = initMode;
   sineOmega = omega;
   sineOmegaPrevious = omega;
+  power = getPowerFromPosY(curveCenterPosY.get(nullptr));
 }
 
 void ShapePoint::updatePositionAbsolute(float x, float y)
@@ -169,6 +205,12 @@ float ShapePoint::getCurveCenterAbsPosY(float previousY, double* modulationAmpli
   return previousY + curveCenterY * yExtent;
 }
 
+void ShapePoint::setCurveCenter(float y)
+{
+  curveCenterPosY.set(y);
+  power = getPowerFromPosY(curveCenterPosY.get(nullptr));
+}
+
 void ShapePoint::updateCurveCenter(float y, float previousY)
 {
   // Nothing to update if curve segment is flat.
@@ -191,7 +233,7 @@ void ShapePoint::updateCurveCenter(float y, float previousY)
 
     // Apply sigmoid.
     float yCenterNew = 0.5f * (1 + std::tanh(combinedOffset / 2));
-    curveCenterPosY.set(yCenterNew);
+    setCurveCenter(yCenterNew);
     break;
   }
 
@@ -245,10 +287,613 @@ int ShapePoint::unserializeState(const IByteChunk& chunk, int startPos, int vers
     startPos = posY.unserializeState(chunk, startPos, version);
     startPos = curveCenterPosY.unserializeState(chunk, startPos, version);
     startPos = chunk.Get(&sineOmega, startPos);
+    power = getPowerFromPosY(curveCenterPosY.get(nullptr));
   }
   return startPos;
 }
 
+float CompiledCurve::getModulated(int i, modulationMode m, float base, double* modulationAmplitudes, float minValue, float maxValue) const
+{
+  float currentValue = base;
+  if (modulationAmplitudes)
+  {
+    int slot = getLinkSlot(i, m);
+    for (int k = linkOffsets[slot]; k < linkOffsets[slot + 1]; k++)
+    {
+      currentValue += modulationAmplitudes[links[k]];
+    }
+  }
+
+  return (currentValue > maxValue) ? maxValue : (currentValue < minValue) ? minValue : currentValue;
+}
+
+float CompiledCurve::getPosX(int i, double* modulationAmplitudes, float lowerBound, float upperBound) const
+{
+  float posX = getModulated(i, modPosX, x[i], modulationAmplitudes, 0.f, 1.f);
+  posX = (posX < lowerBound) ? lowerBound : posX;
+  return (posX > upperBound) ? upperBound : posX;
+}
+
+float CompiledCurve::getPosY(int i, double* modulationAmplitudes) const
+{
+  return getModulated(i, modPosY, y[i], modulationAmplitudes, 0.f, 1.f);
+}
+
+float CompiledCurve::forward(float input, double* modulationAmplitudes, CurveCursor* cursor) const
+{
+  // Catching this case is important because the function might return non-zero values for steep curves
+  // due to quantization errors, which would result in an DC offset even when no input audio is given.
+  if (input == 0) return 0;
+
+  float out;
+
+  // Absolute value of input is processed, information about sign is saved to flip output after computing.
+  bool flipOutput = input < 0;
+  input = (input < 0) ? -input : input;
+  input = (input > 1) ? 1 : input;
+
+  // Unmodulated curves can be evaluated from the lookup table.
+  if (lookupTable.isValid())
+  {
+    out = lookupTable.lookup(input);
+    return flipOutput ? -out : out;
+  }
+
+  // Index of the ShapePoint that corresponds to the input.
+  int idx = 1;
+
+  // Find the curve segment corresponding to the input.
+  // Points can be modulated in x-direction, so the curve segment corresponding to
+  // the input can change over time.
+  // To find the correct segment, a binary search over the unmodulated positions
+  // is performed first. This is very fast.
+  // Afterwards it is checked if the selected point and neighboring points are
+  // modulated along the x-direction. If they are, their modulated position is
+  // determined to calculate the correct shape of the graph. This is slow.
+
+  // If a cursor is given, first check the segment of the previous input and its neighbors.
+  bool isCursorHit = false;
+  if (cursor && (size() > 2))
+  {
+    int cursorIdx = std::min(std::max(cursor->idx, 1), size() - 1);
+    int lowerIdx = std::max(cursorIdx - 1, 1);
+    int upperIdx = std::min(cursorIdx + 1, size() - 1);
+    for (int i = lowerIdx; i <= upperIdx; i++)
+    {
+      if ((x[i - 1] < input) && (x[i] >= input))
+      {
+        idx = i;
+        isCursorHit = true;
+        break;
+      }
+    }
+  }
+
+  // If more than one valid point is in the editor, perform a binary search on the
+  // unmodulated x-positions.
+  if ((size() > 2) && !isCursorHit)
+  {
+    // Lower bound, upper bound and center of the search interval.
+    int lowerIdx = 1;
+    int upperIdx = size() - 1;
+    int center = static_cast<int>((upperIdx + lowerIdx) / 2);
+
+    // x-extent of the curve segment corresponding to the point at center.
+    float lowerX = x[center - 1];
+    float upperX = x[center];
+
+    // Search until the input lies within the curve segment.
+    while ((lowerX >= input) || (upperX < input))
+    {
+      if (lowerX >= input)
+      {
+        upperIdx = center - 1;
+      }
+      else if (upperX < input)
+      {
+        lowerIdx = center + 1;
+      }
+      center = static_cast<int>((upperIdx + lowerIdx) / 2);
+      lowerX = x[center - 1];
+      upperX = x[center];
+    }
+    idx = center;
+  }
+
+  if (cursor)
+  {
+    cursor->idx = idx;
+  }
+
+  // Check if the selected point is x-modulated and if yes, find the next point
+  // with larger x that is not.
+  int modIdx = idx;
+  while (isXModulated[modIdx])
+  {
+    modIdx++;
+  }
+  // Index of the next point at a higher x which position is not
+  // modulated in x-direction.
+  int upperIdx = modIdx;
+
+  modIdx = idx - 1;
+  while (isXModulated[modIdx])
+  {
+    modIdx--;
+  }
+  // Index of the next point at a lower x which position is not
+  // modulated in x-direction.
+  int lowerIdx = modIdx;
+
+  // Find the curve segment concerned by the input inside the interval of
+  // modulated points.
+  // It is defined by two ShapePoints. To calculate their x-position,
+  // the position of the previous point must be known to provide a
+  // lower bound.
+  float lowerBoundPrevious = x[lowerIdx];
+  float lowerBound = lowerBoundPrevious;
+  float upperBound = x[upperIdx];
+
+  if ((upperIdx - lowerIdx) > 1)
+  {
+    for (int i = lowerIdx; i <= upperIdx; i++)
+    {
+      lowerBoundPrevious = lowerBound;
+      lowerBound = getPosX(i, modulationAmplitudes, lowerBound);
+
+      if (lowerBound >= input)
+      {
+        idx = i;
+        break;
+      }
+    }
+  }
+
+  // Evaluate the curve segment at the input.
+  switch (mode[idx])
+  {
+  case shapePower: {
+    float xL = getPosX(idx - 1, modulationAmplitudes, lowerBoundPrevious, upperBound);
+    float yL = getPosY(idx - 1, modulationAmplitudes);
+    float xU = getPosX(idx, modulationAmplitudes, lowerBound, upperBound);
+    float yU = getPosY(idx, modulationAmplitudes);
+
+    // Compute relative x-position inside the curve segment, relative "height" of the curve segment and power
+    // corresponding to the current curve cenetr position.
+    float relX = 0;
+    if (isXModulated[idx] || isXModulated[idx - 1])
+    {
+      relX = (xU == xL) ? xL : (input - xL) / (xU - xL);
+    }
+    else
+    {
+      relX = (xU == xL) ? xL : (input - xL) * invXExtent[idx];
+    }
+    float segmentYExtent = yU - yL;
+
+    // The power only has to be recalculated if the curve center is modulated.
+    int slot = getLinkSlot(idx, modCurveCenterY);
+    float segmentPower = power[idx];
+    if (modulationAmplitudes && (linkOffsets[slot] != linkOffsets[slot + 1]))
+    {
+      segmentPower = getPowerFromPosY(getModulated(idx, modCurveCenterY, centerY[idx], modulationAmplitudes, MIN_CURVE_CENTER, 1 - MIN_CURVE_CENTER));
+    }
+
+    if (segmentPower > 0)
+    {
+      out = yL + pow(relX, segmentPower) * segmentYExtent;
+    }
+    else
+    {
+      out = yU - pow(1 - relX, -segmentPower) * segmentYExtent;
+    }
+    break;
+  }
+  case shapeSine:
+    out = 1.;
+    break;
+  }
+  return flipOutput ? -out : out;
+}
+
+#ifdef UDS_SIMD
+// Segment search in forwardSIMD compares the input against all points of curves with
+// up to this many points. Larger curves use a binary search per sample.
+constexpr int SIMD_LINEAR_SEARCH_LIMIT = 16;
+
+// Evaluates SIMD_WIDTH samples of an unmodulated curve that consists only of shapePower segments.
+// Equivalent to CompiledCurve::forward without modulation.
+static SIMDFloat forwardSIMD(const CompiledCurve& curve, SIMDFloat input)
+{
+  const int n = curve.size();
+
+  // Process the absolute value and restore the sign afterwards. Inputs that are exactly zero
+  // must result in zero, see CompiledCurve::forward.
+  SIMDFloat signBits = simdSignBits(input);
+  SIMDFloat isZero = simdEqual(input, simdZero());
+  SIMDFloat x = simdMin(simdAbs(input), simdSet(1.f));
+
+  // Find the index of the first point with an x-position >= input. Since the points are sorted,
+  // this is equal to the number of points with an x-position < input.
+  SIMDInt idx;
+  if (n <= SIMD_LINEAR_SEARCH_LIMIT)
+  {
+    idx = simdIntSet(0);
+    for (int i = 0; i < n; i++)
+    {
+      // Comparisons return -1 for true.
+      idx = simdIntSub(idx, simdCastToInt(simdLess(simdSet(curve.x[i]), x)));
+    }
+  }
+  else
+  {
+    alignas(32) float in[SIMD_WIDTH];
+    alignas(32) int out[SIMD_WIDTH];
+    simdStore(in, x);
+    for (int i = 0; i < SIMD_WIDTH; i++)
+    {
+      out[i] = static_cast<int>(std::lower_bound(curve.x.begin(), curve.x.end(), in[i]) - curve.x.begin());
+    }
+    idx = simdIntLoad(out);
+  }
+
+  // Zero inputs would give index 0, which has no segment.
+  idx = simdIntMin(simdIntMax(idx, simdIntSet(1)), simdIntSet(n - 1));
+  SIMDInt idxL = simdIntSub(idx, simdIntSet(1));
+
+  SIMDFloat xL = simdGather(curve.x.data(), idxL);
+  SIMDFloat xU = simdGather(curve.x.data(), idx);
+  SIMDFloat yL = simdGather(curve.y.data(), idxL);
+  SIMDFloat yU = simdGather(curve.y.data(), idx);
+  SIMDFloat power = simdGather(curve.power.data(), idx);
+
+  SIMDFloat invXExtent = simdGather(curve.invXExtent.data(), idx);
+
+  SIMDFloat relX = simdMul(simdSub(x, xL), invXExtent);
+  relX = simdSelect(simdEqual(xU, xL), xL, relX);
+  SIMDFloat segmentYExtent = simdSub(yU, yL);
+
+  // Negative powers describe mirrored curves that are evaluated from the upper point.
+  SIMDFloat mirrored = simdLess(power, simdZero());
+  SIMDFloat base = simdSelect(mirrored, simdSub(simdSet(1.f), relX), relX);
+  power = simdAbs(power);
+
+  // Linear segments are common, skip the power if all samples are on one.
+  if (simdMoveMask(simdNotEqual(power, simdSet(1.f))))
+  {
+    base = simdPow(base, power);
+  }
+
+  SIMDFloat out = simdSelect(mirrored, simdSub(yU, simdMul(base, segmentYExtent)), simdAdd(yL, simdMul(base, segmentYExtent)));
+  out = simdAndNot(isZero, out);
+  return simdXor(out, signBits);
+}
+#endif
+
+void CompiledCurve::forwardBlock(const iplug::sample* input, iplug::sample* output, int n, double* modulationAmplitudes, CurveCursor* cursor, const POINormalizer* norms) const
+{
+  // Normalization is applied on the way into and out of the evaluation, such that the
+  // samples pass through memory only once. norms does not change within the loops.
+  auto normalize = [norms, input](int i) { return norms ? norms[i].normalize(input[i]) : input[i]; };
+  auto revert = [norms](int i, float out) { return norms ? norms[i].revertNormalize(out) : static_cast<iplug::sample>(out); };
+
+  if (lookupTable.isValid())
+  {
+    for (int i = 0; i < n; i++)
+    {
+      float in = static_cast<float>(normalize(i));
+      float absIn = std::min((in < 0) ? -in : in, 1.f);
+      float out = lookupTable.lookup(absIn);
+
+      // Zero inputs must result in zero, like in forward. The table is interpolated and does not
+      // guarantee this, but silent chunks are skipped on the assumption that they map to zero.
+      out = (in == 0) ? 0.f : out;
+      output[i] = revert(i, (in < 0) ? -out : out);
+    }
+    return;
+  }
+
+#ifdef UDS_SIMD
+  if (!(modulationAmplitudes && isModulated()) && !hasSineSegments)
+  {
+    alignas(32) float buffer[SIMD_WIDTH];
+    for (int i = 0; i < n; i += SIMD_WIDTH)
+    {
+      // The last chunk might be incomplete, pad it with zeros.
+      int chunkSize = std::min(SIMD_WIDTH, n - i);
+      for (int j = 0; j < SIMD_WIDTH; j++)
+      {
+        buffer[j] = (j < chunkSize) ? static_cast<float>(normalize(i + j)) : 0.f;
+      }
+
+      simdStore(buffer, forwardSIMD(*this, simdLoad(buffer)));
+
+      for (int j = 0; j < chunkSize; j++)
+      {
+        output[i + j] = revert(i + j, buffer[j]);
+      }
+    }
+    return;
+  }
+#endif
+
+  for (int i = 0; i < n; i++)
+  {
+    output[i] = revert(i, forward(static_cast<float>(normalize(i)), modulationAmplitudes, cursor));
+  }
+}
+
+// Interpolates between the table entries v[0] and v[1] at relative position t.
+// Cubic interpolation additionally reads v[-1] and v[2].
+static float interpolateTable(const float* v, float t, curveLookupMode mode)
+{
+  if (mode == lookupCubic)
+  {
+    // Catmull-Rom spline through v[-1], v[0], v[1], v[2].
+    return v[0] + 0.5f * t * (v[1] - v[-1] + t * (2 * v[-1] - 5 * v[0] + 4 * v[1] - v[2] + t * (3 * (v[0] - v[1]) + v[2] - v[-1])));
+  }
+  return v[0] + t * (v[1] - v[0]);
+}
+
+float CurveLookupTable::lookup(float input) const
+{
+  int bucket = std::min(static_cast<int>(input * LOOKUP_TABLE_CELLS), LOOKUP_TABLE_CELLS - 1);
+
+  // Buckets only overlap more than one cell if they contain points.
+  int cell = bucketCells[bucket];
+  while (input > cellEnds[cell])
+  {
+    cell++;
+  }
+
+  float pos = (input - cellStarts[cell]) * cellScales[cell];
+  int idx = std::min(static_cast<int>(pos), cellSizes[cell] - 1);
+
+  return interpolateTable(values.data() + cellOffsets[cell] + idx, pos - idx, mode);
+}
+
+void CurveLookupTable::clear()
+{
+  mode = lookupNone;
+  bucketCells.clear();
+  cellStarts.clear();
+  cellEnds.clear();
+  cellScales.clear();
+  cellOffsets.clear();
+  cellSizes.clear();
+  values.clear();
+}
+
+void CompiledCurve::buildLookupTable(curveLookupMode mode, float maxError)
+{
+  // The table must be invalid while building, forward would use it otherwise.
+  lookupTable.clear();
+  lookupTable.bucketCells.resize(LOOKUP_TABLE_CELLS);
+
+  if ((mode == lookupNone) || isModulated()) return;
+
+  // The function has kinks or jumps at the points, so they must lie on cell boundaries.
+  std::vector<float> boundaries;
+  for (int i = 0; i <= LOOKUP_TABLE_CELLS; i++)
+  {
+    boundaries.push_back(static_cast<float>(i) / LOOKUP_TABLE_CELLS);
+  }
+  for (int i = 1; i < size() - 1; i++)
+  {
+    boundaries.push_back(x[i]);
+  }
+  std::sort(boundaries.begin(), boundaries.end());
+  boundaries.erase(std::unique(boundaries.begin(), boundaries.end()), boundaries.end());
+
+  // Number of entries outside of each cell.
+  const int guard = (mode == lookupCubic) ? 1 : 0;
+
+  std::vector<float> cellValues;
+  for (int cell = 0; cell < static_cast<int>(boundaries.size()) - 1; cell++)
+  {
+    const float cellStart = boundaries[cell];
+    const float cellEnd = boundaries[cell + 1];
+    const float cellWidth = cellEnd - cellStart;
+
+    // Double the resolution of the cell until the error is small enough.
+    int cellSize = 1;
+    bool isAccurate = false;
+    while (!isAccurate && (cellSize <= LOOKUP_TABLE_MAX_CELL_SIZE))
+    {
+      cellValues.resize(cellSize + 1 + 2 * guard);
+      float* v = cellValues.data() + guard;
+      for (int j = 0; j <= cellSize; j++)
+      {
+        v[j] = forward(cellStart + cellWidth * j / cellSize);
+      }
+
+      // At a jump of the function, forward returns the value left of the jump. The cell starts
+      // right of it.
+      v[0] = forward(std::nextafter(cellStart, 2.f));
+
+      if (guard)
+      {
+        v[-1] = 2 * v[0] - v[1];
+        v[cellSize + 1] = 2 * v[cellSize] - v[cellSize - 1];
+      }
+
+      // Compare a few positions of every interval against the exact function.
+      // On steep segments, the exact function itself is only accurate up to the rounding
+      // error of its input times the slope, which is added to the allowed error.
+      isAccurate = true;
+      for (int j = 0; (j < cellSize) && isAccurate; j++)
+      {
+        float slope = std::abs(v[j + 1] - v[j]) * cellSize / cellWidth;
+        float tolerance = maxError + 4 * slope * cellEnd * std::numeric_limits<float>::epsilon();
+        for (int k = 1; (k < 4) && isAccurate; k++)
+        {
+          float t = 0.25f * k;
+          float error = interpolateTable(v + j, t, mode) - forward(cellStart + cellWidth * (j + t) / cellSize);
+          isAccurate = (error <= tolerance) && (error >= -tolerance);
+        }
+      }
+
+      if (!isAccurate)
+      {
+        cellSize *= 2;
+      }
+    }
+
+    if (!isAccurate || (lookupTable.values.size() + cellValues.size() > LOOKUP_TABLE_MAX_SIZE))
+    {
+      lookupTable.values.clear();
+      return;
+    }
+
+    lookupTable.cellStarts.push_back(cellStart);
+    lookupTable.cellEnds.push_back(cellEnd);
+    lookupTable.cellScales.push_back(cellSize / cellWidth);
+    lookupTable.cellOffsets.push_back(static_cast<int>(lookupTable.values.size()) + guard);
+    lookupTable.cellSizes.push_back(cellSize);
+    lookupTable.values.insert(lookupTable.values.end(), cellValues.begin(), cellValues.end());
+  }
+
+  // Rounding must not let inputs of 1 pass the last cell.
+  lookupTable.cellEnds.back() = 1.f;
+
+  for (int bucket = 0; bucket < LOOKUP_TABLE_CELLS; bucket++)
+  {
+    float bucketStart = static_cast<float>(bucket) / LOOKUP_TABLE_CELLS;
+    auto it = std::lower_bound(lookupTable.cellEnds.begin(), lookupTable.cellEnds.end(), bucketStart);
+    lookupTable.bucketCells[bucket] = static_cast<int>(it - lookupTable.cellEnds.begin());
+  }
+
+  lookupTable.mode = mode;
+}
+
+void CompiledCurve::resolve(double* modulationAmplitudes, ResolvedCurve& resolved) const
+{
+  // Load the unmodulated values if the curve has changed.
+  if ((resolved.source != this) || (resolved.revision != revision))
+  {
+    resolved.source = this;
+    resolved.revision = revision;
+    // The storage is reserved for MAX_SHAPE_POINTS points, so resizing does not allocate.
+    resolved.x.resize(size());
+    resolved.y.resize(size());
+    resolved.power.resize(size());
+    resolved.invXExtent.resize(size());
+    resolved.mode.resize(size());
+    std::copy(x.begin(), x.end(), resolved.x.begin());
+    std::copy(y.begin(), y.end(), resolved.y.begin());
+    std::copy(power.begin(), power.end(), resolved.power.begin());
+    std::copy(invXExtent.begin(), invXExtent.end(), resolved.invXExtent.begin());
+    std::copy(mode.begin(), mode.end(), resolved.mode.begin());
+  }
+
+  // Points are processed in ascending order, so the position of the previous point is
+  // always resolved before it is used as a lower bound.
+  for (int k = 0; k < static_cast<int>(modulatedPoints.size()); k++)
+  {
+    int i = modulatedPoints[k];
+
+    if (isXModulated[i])
+    {
+      resolved.x[i] = getPosX(i, modulationAmplitudes, resolved.x[i - 1], x[upperFixedPoints[k]]);
+
+      // The x-extent of this and the next segment changed. If the next point is modulated,
+      // its segment is updated again when it is resolved.
+      float xExtent = resolved.x[i] - resolved.x[i - 1];
+      resolved.invXExtent[i] = (xExtent > 0) ? 1 / xExtent : 0.f;
+      if (i + 1 < size())
+      {
+        xExtent = resolved.x[i + 1] - resolved.x[i];
+        resolved.invXExtent[i + 1] = (xExtent > 0) ? 1 / xExtent : 0.f;
+      }
+    }
+
+    resolved.y[i] = getPosY(i, modulationAmplitudes);
+
+    int slot = getLinkSlot(i, modCurveCenterY);
+    if (linkOffsets[slot] != linkOffsets[slot + 1])
+    {
+      resolved.power[i] = getPowerFromPosY(getModulated(i, modCurveCenterY, centerY[i], modulationAmplitudes, MIN_CURVE_CENTER, 1 - MIN_CURVE_CENTER));
+    }
+  }
+}
+
+ResolvedCurve::ResolvedCurve()
+{
+  x.reserve(MAX_SHAPE_POINTS);
+  y.reserve(MAX_SHAPE_POINTS);
+  power.reserve(MAX_SHAPE_POINTS);
+  invXExtent.reserve(MAX_SHAPE_POINTS);
+  mode.reserve(MAX_SHAPE_POINTS);
+}
+
+float ResolvedCurve::forward(float input, CurveCursor* cursor) const
+{
+  // See CompiledCurve::forward.
+  if (input == 0) return 0;
+
+  bool flipOutput = input < 0;
+  input = (input < 0) ? -input : input;
+  input = (input > 1) ? 1 : input;
+
+  // Index of the point at the upper end of the segment corresponding to the input.
+  int idx = 1;
+
+  bool isCursorHit = false;
+  if (cursor && (size() > 2))
+  {
+    int cursorIdx = std::min(std::max(cursor->idx, 1), size() - 1);
+    int lowerIdx = std::max(cursorIdx - 1, 1);
+    int upperIdx = std::min(cursorIdx + 1, size() - 1);
+    for (int i = lowerIdx; i <= upperIdx; i++)
+    {
+      if ((x[i - 1] < input) && (x[i] >= input))
+      {
+        idx = i;
+        isCursorHit = true;
+        break;
+      }
+    }
+  }
+
+  // The resolved positions are sorted, so the segment is at the first point with x >= input.
+  if ((size() > 2) && !isCursorHit)
+  {
+    idx = static_cast<int>(std::lower_bound(x.begin() + 1, x.end() - 1, input) - x.begin());
+  }
+
+  if (cursor)
+  {
+    cursor->idx = idx;
+  }
+
+  float out = 1.;
+  if (mode[idx] == shapePower)
+  {
+    float xL = x[idx - 1];
+    float xU = x[idx];
+    float relX = (xU == xL) ? xL : (input - xL) * invXExtent[idx];
+    float segmentYExtent = y[idx] - y[idx - 1];
+
+    if (power[idx] > 0)
+    {
+      out = y[idx - 1] + pow(relX, power[idx]) * segmentYExtent;
+    }
+    else
+    {
+      out = y[idx] - pow(1 - relX, -power[idx]) * segmentYExtent;
+    }
+  }
+  return flipOutput ? -out : out;
+}
+
+void ResolvedCurve::forwardBlock(const iplug::sample* input, iplug::sample* output, int n, CurveCursor* cursor) const
+{
+  for (int i = 0; i < n; i++)
+  {
+    output[i] = forward(static_cast<float>(input[i]), cursor);
+  }
+}
+
 ShapeEditor::ShapeEditor(IRECT rect, float GUIWidth, float GUIHeight, int shapeEditorIndex)
   : index(shapeEditorIndex)
   , layout(rect, GUIWidth, GUIHeight)
@@ -259,6 +904,8 @@ ShapeEditor::ShapeEditor(IRECT rect, float GUIWidth, float GUIHeight, int shapeE
   // on the interval [0, 1].
   shapePoints.emplace_back(0.f, 0.f, layout.editorRect);
   shapePoints.emplace_back(1.f, 1.f, layout.editorRect);
+  compileCurve();
+  refreshLookupTable();
 }
 
 int ShapeEditor::getClosestPoint(float x, float y, bool& curveCenter, float minimumDistance)
@@ -323,6 +970,7 @@ void ShapeEditor::deleteSelectedPoint()
 
     shapePoints.erase(shapePoints.begin() + rightClickedIdx);
     rightClickedIdx = -1;
+    compileCurve();
   }
 }
 
@@ -356,13 +1004,14 @@ void ShapeEditor::processDoubleClick(float x, float y)
   {
     if (shapePoints.at(closestPointIdx).mode == shapePower)
     {
-      shapePoints.at(closestPointIdx).curveCenterPosY.set(0.5);
+      shapePoints.at(closestPointIdx).setCurveCenter(0.5);
     }
     else if (shapePoints.at(closestPointIdx).mode == shapeSine)
     {
       shapePoints.at(closestPointIdx).sineOmega = 0.5;
       shapePoints.at(closestPointIdx).sineOmegaPrevious = 0.5;
     }
+    compileCurve();
     return;
   }
 }
@@ -375,8 +1024,9 @@ bool ShapeEditor::processRightClick(float x, float y)
   // If not rightclicked in proximity of point, add one.
   if (closestPointIdx == -1)
   {
-    // Check if point lies inside the editor.
+    // Check if point lies inside the editor and if there is space for another point.
     if (!layout.editorRect.Contains(x, y)) return false;
+    if (shapePoints.size() >= MAX_SHAPE_POINTS) return false;
 
     float newPointX = (x - layout.editorRect.L) / layout.editorRect.W();
     float newPointY = (layout.editorRect.B - y) / layout.editorRect.H();
@@ -407,13 +1057,14 @@ bool ShapeEditor::processRightClick(float x, float y)
     {
       if (shapePoints.at(closestPointIdx).mode == shapePower)
       {
-        shapePoints.at(closestPointIdx).curveCenterPosY.set(0.5);
+        shapePoints.at(closestPointIdx).setCurveCenter(0.5);
       }
       else if (shapePoints.at(closestPointIdx).mode == shapeSine)
       {
         shapePoints.at(closestPointIdx).sineOmega = 0.5;
         shapePoints.at(closestPointIdx).sineOmegaPrevious = 0.5;
       }
+      compileCurve();
     }
   }
   return false;
@@ -423,6 +1074,7 @@ void ShapeEditor::setInterpolationMode(Shapes shape)
 {
   shapePoints.at(rightClickedIdx).mode = shape;
   rightClickedIdx = -1;
+  compileCurve();
 }
 
 void ShapeEditor::processMouseDrag(float x, float y)
@@ -437,6 +1089,7 @@ void ShapeEditor::processMouseDrag(float x, float y)
       x = layout.editorRect.R;
       y = (y > layout.editorRect.B) ? layout.editorRect.B : (y < layout.editorRect.T) ? layout.editorRect.T : y;
       shapePoints.at(currentlyDraggingIdx).updatePositionAbsolute(x, y);
+      compileCurve();
       return;
     }
 
@@ -447,12 +1100,14 @@ void ShapeEditor::processMouseDrag(float x, float y)
     y = (y > layout.editorRect.B) ? layout.editorRect.B : (y < layout.editorRect.T) ? layout.editorRect.T : y;
 
     shapePoints.at(currentlyDraggingIdx).updatePositionAbsolute(x, y);
+    compileCurve();
   }
 
   else if (currentEditMode == editMode::curveCenter)
   {
     float previousY = shapePoints.at(currentlyDraggingIdx - 1).getAbsPosY();
     shapePoints.at(currentlyDraggingIdx).updateCurveCenter(y, previousY);
+    compileCurve();
   }
 }
 
@@ -490,133 +1145,118 @@ void ShapeEditor::getMouseReveal(bool& revealCursor, float& x, float& y) const
 
 float ShapeEditor::forward(float input, double* modulationAmplitudes) const
 {
-  // Catching this case is important because the function might return non-zero values for steep curves
-  // due to quantization errors, which would result in an DC offset even when no input audio is given.
-  if (input == 0) return 0;
-
-  float out;
-
-  // Absolute value of input is processed, information about sign is saved to flip output after computing.
-  bool flipOutput = input < 0;
-  input = (input < 0) ? -input : input;
-  input = (input > 1) ? 1 : input;
+  return compiledCurve.forward(input, modulationAmplitudes);
+}
 
-  // Index of the ShapePoint that corresponds to the input.
-  int idx = 1;
+void ShapeEditor::forwardBlock(const iplug::sample* input, iplug::sample* output, int n, double* modulationAmplitudes) const
+{
+  compiledCurve.forwardBlock(input, output, n, modulationAmplitudes);
+}
 
-  // Find the curve segment corresponding to the input.
-  // Points can be modulated in x-direction, so the curve segment corresponding to
-  // the input can change over time.
-  // To find the correct segment, a binary search over the unmodulated positions
-  // is performed first. This is very fast.
-  // Afterwards it is checked if the selected point and neighboring points are
-  // modulated along the x-direction. If they are, their modulated position is
-  // determined to calculate the correct shape of the graph. This is slow.
+void ShapeEditor::compileCurve()
+{
+  int n = static_cast<int>(shapePoints.size());
+
+  compiledCurve.x.resize(n);
+  compiledCurve.y.resize(n);
+  compiledCurve.centerY.resize(n);
+  compiledCurve.power.resize(n);
+  compiledCurve.invXExtent.resize(n);
+  compiledCurve.mode.resize(n);
+  compiledCurve.isXModulated.resize(n);
+  compiledCurve.linkOffsets.resize(3 * n + 1);
+  compiledCurve.links.clear();
+  compiledCurve.hasSineSegments = false;
+
+  // Collects the links of each parameter. Links are added in the order of the slots
+  // returned by CompiledCurve::getLinkSlot.
+  auto addLinks = [&](const ModulatedParameter& parameter) {
+    for (int k = 0; k < parameter.getNumModulators(); k++)
+    {
+      compiledCurve.links.push_back(parameter.getModulator(k));
+    }
+  };
 
-  // If more than one valid point is in the editor, perform a binary search on the
-  // unmodulated x-positions.
-  if (shapePoints.size() > 2)
+  for (int i = 0; i < n; i++)
   {
-    // Lower bound, upper bound and center of the search interval.
-    int lowerIdx = 1;
-    int upperIdx = shapePoints.size() - 1;
-    int center = static_cast<int>((upperIdx + lowerIdx) / 2);
+    const ShapePoint& point = shapePoints.at(i);
+    compiledCurve.x.at(i) = point.posX.get(nullptr);
+    compiledCurve.y.at(i) = point.posY.get(nullptr);
+    compiledCurve.centerY.at(i) = point.curveCenterPosY.get(nullptr);
+    compiledCurve.power.at(i) = point.power;
+    compiledCurve.mode.at(i) = point.mode;
+    compiledCurve.isXModulated.at(i) = point.posX.isModulated();
+    compiledCurve.hasSineSegments = compiledCurve.hasSineSegments || ((i > 0) && (point.mode != shapePower));
+
+    float xExtent = (i > 0) ? compiledCurve.x.at(i) - compiledCurve.x.at(i - 1) : 0.f;
+    compiledCurve.invXExtent.at(i) = (xExtent > 0) ? 1 / xExtent : 0.f;
+
+    compiledCurve.linkOffsets.at(CompiledCurve::getLinkSlot(i, modCurveCenterY)) = compiledCurve.links.size();
+    addLinks(point.curveCenterPosY);
+    compiledCurve.linkOffsets.at(CompiledCurve::getLinkSlot(i, modPosX)) = compiledCurve.links.size();
+    addLinks(point.posX);
+    compiledCurve.linkOffsets.at(CompiledCurve::getLinkSlot(i, modPosY)) = compiledCurve.links.size();
+    addLinks(point.posY);
+  }
+  compiledCurve.linkOffsets.at(3 * n) = compiledCurve.links.size();
 
-    // x-extent of the curve segment corresponding to the point at center.
-    float lowerX = shapePoints.at(center - 1).posX.get(nullptr);
-    float upperX = shapePoints.at(center).posX.get(nullptr);
+  compiledCurve.modulatedPoints.clear();
+  compiledCurve.upperFixedPoints.clear();
+  for (int i = 1; i < n; i++)
+  {
+    int firstSlot = CompiledCurve::getLinkSlot(i, modCurveCenterY);
+    if (compiledCurve.linkOffsets.at(firstSlot) == compiledCurve.linkOffsets.at(firstSlot + 3)) continue;
 
-    // Search until the input lies within the curve segment.
-    while ((lowerX >= input) || (upperX < input))
+    int upperIdx = i;
+    while ((upperIdx < n - 1) && compiledCurve.isXModulated.at(upperIdx))
     {
-      if (lowerX >= input)
-      {
-        upperIdx = center - 1;
-      }
-      else if (upperX < input)
-      {
-        lowerIdx = center + 1;
-      }
-      center = static_cast<int>((upperIdx + lowerIdx) / 2);
-      lowerX = shapePoints.at(center - 1).posX.get(nullptr);
-      upperX = shapePoints.at(center).posX.get(nullptr);
+      upperIdx++;
     }
-    idx = center;
+    compiledCurve.modulatedPoints.push_back(i);
+    compiledCurve.upperFixedPoints.push_back(upperIdx);
   }
+  compiledCurve.revision++;
 
-  // Check if the selected point is x-modulated and if yes, find the next point
-  // with larger x that is not.
-  int modIdx = idx;
-  while (shapePoints.at(modIdx).posX.isModulated())
-  {
-    modIdx++;
-  }
-  // Index of the next point at a higher x which position is not
-  // modulated in x-direction.
-  int upperIdx = modIdx;
+  // The table of the previous curve is invalid, it is rebuilt by refreshLookupTable. Clearing
+  // it also keeps publish from copying the stale entries on every mouse drag event.
+  compiledCurve.lookupTable.clear();
+  lookupTablePending = (index != -1) && (lookupMode != lookupNone);
 
-  modIdx = idx - 1;
-  while (shapePoints.at(modIdx).posX.isModulated())
-  {
-    modIdx--;
-  }
-  // Index of the next point at a lower x which position is not
-  // modulated in x-direction.
-  int lowerIdx = modIdx;
+  publishCompiledCurve();
+}
 
-  // Find the curve segment concerned by the input inside the interval of
-  // modulated points.
-  // It is defined by two ShapePoints. To calculate their x-position,
-  // the position of the previous point must be known to provide a
-  // lower bound.
-  float lowerBoundPrevious = shapePoints.at(lowerIdx).getPosX();
-  float lowerBound = lowerBoundPrevious;
-  float upperBound = shapePoints.at(upperIdx).getPosX();
+void ShapeEditor::refreshLookupTable()
+{
+  if (!lookupTablePending || (currentEditMode != editMode::none)) return;
 
-  if ((upperIdx - lowerIdx) > 1)
-  {
-    for (int i = lowerIdx; i <= upperIdx; i++)
-    {
-      lowerBoundPrevious = lowerBound;
-      lowerBound = shapePoints.at(i).getPosX(modulationAmplitudes, lowerBound);
+  lookupTablePending = false;
+  compiledCurve.buildLookupTable(lookupMode, lookupMaxError);
+  publishCompiledCurve();
+}
 
-      if (lowerBound >= input)
-      {
-        idx = i;
-        break;
-      }
-    }
-  }
+void ShapeEditor::setLookupMode(curveLookupMode mode, float maxError)
+{
+  lookupMode = mode;
+  lookupMaxError = maxError;
+  compileCurve();
+  refreshLookupTable();
+}
 
-  // Evaluate the curve segment at the input.
-  switch (shapePoints.at(idx).mode)
-  {
-  case shapePower: {
-    float xL = shapePoints.at(idx - 1).getPosX(modulationAmplitudes, lowerBoundPrevious, upperBound);
-    float yL = shapePoints.at(idx - 1).getPosY(modulationAmplitudes);
-    float x = shapePoints.at(idx).getPosX(modulationAmplitudes, lowerBound, upperBound);
+const CompiledCurve& ShapeEditor::getCompiledCurve() const
+{
+  return compiledCurve;
+}
 
-    // Compute relative x-position inside the curve segment, relative "height" of the curve segment and power
-    // corresponding to the current curve cenetr position.
-    float relX = (x == xL) ? xL : (input - xL) / (x - xL);
-    float segmentYExtent = (shapePoints.at(idx).getPosY(modulationAmplitudes) - yL);
-    float power = getPowerFromPosY(shapePoints.at(idx).curveCenterPosY.get(modulationAmplitudes));
+void ShapeEditor::publishCompiledCurve()
+{
+  // The vectors of the back buffer keep their capacity, so this only allocates if the curve grew.
+  snapshots->getBack() = compiledCurve;
+  snapshots->publish();
+}
 
-    if (power > 0)
-    {
-      out = yL + pow(relX, power) * segmentYExtent;
-    }
-    else
-    {
-      out = shapePoints.at(idx).getPosY(modulationAmplitudes) - pow(1 - relX, -power) * segmentYExtent;
-    }
-    break;
-  }
-  case shapeSine:
-    out = 1.;
-    break;
-  }
-  return flipOutput ? -out : out;
+const CompiledCurve& ShapeEditor::acquireCompiledCurve()
+{
+  return snapshots->acquire();
 }
 
 void ShapeEditor::attachUI(IGraphics* g)
@@ -641,6 +1281,7 @@ void ShapeEditor::disconnectLink(int linkIdx)
     shapePoints.at(i).posY.removeModulator(linkIdx);
     shapePoints.at(i).curveCenterPosY.removeModulator(linkIdx);
   }
+  compileCurve();
 }
 
 void ShapeEditor::getLinks(std::set<int>& links)
@@ -666,6 +1307,7 @@ int ShapeEditor::insertPointAt(float x, float y)
     }
   }
   shapePoints.emplace(shapePoints.begin() + idx, x, y, layout.editorRect);
+  compileCurve();
   return idx;
 }
 
@@ -706,18 +1348,32 @@ int ShapeEditor::unserializeState(const IByteChunk& chunk, int startPos, int ver
     int numberPoints;
     startPos = chunk.Get(&numberPoints, startPos);
 
-    shapePoints.reserve(numberPoints + 1);
+    // Curves can not have more than MAX_SHAPE_POINTS points, since the audio thread only reserves
+    // storage for that many. Surplus points in front of the last point are read and discarded.
+    int numberLoaded = std::min(numberPoints, MAX_SHAPE_POINTS - 1);
+    shapePoints.reserve(numberLoaded + 1);
 
     for (int i = 0; i < numberPoints; i++)
     {
-      if (i != numberPoints - 1)
+      bool isLast = (i == numberPoints - 1);
+      if (!isLast && (i >= numberLoaded - 1))
+      {
+        ShapePoint surplus(0.f, 0.f, layout.editorRect);
+        startPos = surplus.unserializeState(chunk, startPos, version);
+        continue;
+      }
+
+      int idx = isLast ? numberLoaded : i + 1;
+      if (!isLast)
       {
         // Add new points unless the last point is reached, which was already created at instantiation
         // of this ShapeEditor.
-        shapePoints.emplace(shapePoints.begin() + i + 1, 0.f, 0.f, layout.editorRect);
+        shapePoints.emplace(shapePoints.begin() + idx, 0.f, 0.f, layout.editorRect);
       }
-      startPos = shapePoints.at(i + 1).unserializeState(chunk, startPos, version);
+      startPos = shapePoints.at(idx).unserializeState(chunk, startPos, version);
     }
+    compileCurve();
+    refreshLookupTable();
     return startPos;
   }
   else
@@ -739,6 +1395,12 @@ ShapeEditorControl::ShapeEditorControl(const IRECT& bounds, const IRECT& editorB
 {
   editor = shapeEditor;
   mPoints.resize(numPoints);
+  mOutputs.resize(numPoints);
+  mInputs.resize(numPoints);
+  for (int i = 0; i < numPoints; i++)
+  {
+    mInputs.at(i) = static_cast<iplug::sample>(i) / static_cast<iplug::sample>(numPoints - 1);
+  }
 
   AttachIControl(this, "");
 
@@ -774,11 +1436,19 @@ void ShapeEditorControl::Draw(IGraphics& g)
     g.DrawGrid(UDS_WHITE, editorRect, hdiv, vdiv, &gridBlend);
 
     // Draw the graph of the shaping function.
+    const CompiledCurve& curve = editor->getCompiledCurve();
+    if (curve.isModulated())
+    {
+      curve.resolve(modulationAmplitudes, mResolved);
+      mResolved.forwardBlock(mInputs.data(), mOutputs.data(), static_cast<int>(mOutputs.size()));
+    }
+    else
+    {
+      curve.forwardBlock(mInputs.data(), mOutputs.data(), static_cast<int>(mOutputs.size()));
+    }
     for (int i = 0; i < mPoints.size(); i++)
     {
-      float v = editor->forward(static_cast<float>(i) / static_cast<float>(mPoints.size() - 1), modulationAmplitudes);
-      v = (v - mMin) / (mMax - mMin);
-      mPoints.at(i) = v;
+      mPoints.at(i) = (static_cast<float>(mOutputs.at(i)) - mMin) / (mMax - mMin);
     }
 
     g.DrawData(UDS_WHITE, editorRect, mPoints.data(), static_cast<int>(mPoints.size()), nullptr, &mBlend, mTrackSize);
@@ -941,6 +1611,9 @@ void ShapeEditorControl::OnMouseUp(float x, float y, const IMouseMod& mod)
 
   editor->currentEditMode = editMode::none;
   cumulativeDragOffset = 0.f;
+
+  // The edit is finished, build the lookup table once for the final curve.
+  editor->refreshLookupTable();
 }
 
 void ShapeEditorControl::OnMouseDblClick(float x, float y, const IMouseMod& mod)
@@ -986,6 +1659,7 @@ void ShapeEditorControl::OnPopupMenuSelection(IPopupMenu* pSelectedMenu, int val
     {
       if (editor->shapePoints.at(modPointIdx).posX.addModulator(modIdx))
       {
+        editor->compileCurve();
         GetUI()->GetDelegate()->SendArbitraryMsgFromUI(EControlMsg::LFOConnectSuccess, GetTag(), sizeof(modIdx), &modIdx);
       }
     }
@@ -993,6 +1667,7 @@ void ShapeEditorControl::OnPopupMenuSelection(IPopupMenu* pSelectedMenu, int val
     {
       if (editor->shapePoints.at(modPointIdx).posY.addModulator(modIdx))
       {
+        editor->compileCurve();
         GetUI()->GetDelegate()->SendArbitraryMsgFromUI(EControlMsg::LFOConnectSuccess, GetTag(), sizeof(modIdx), &modIdx);
       }
     }
@@ -1028,6 +1703,7 @@ void ShapeEditorControl::OnMsgFromDelegate(int msgTag, int dataSize, const void*
         // If the connect was successfull send a response message to update the LFO UI.
         if (editor->shapePoints.at(closestPointIdx).curveCenterPosY.addModulator(info.idx))
         {
+          editor->compileCurve();
           GetUI()->GetDelegate()->SendArbitraryMsgFromUI(EControlMsg::LFOConnectSuccess, GetTag(), sizeof(info.idx), &info.idx);
         }
       }
@@ -2,6 +2,8 @@
 
 #include <assert.h>
 #include <set>
+#include <atomic>
+#include <memory>
 #include <math.h>
 #include "IControls.h"
 #include "../GUILayout.h"
@@ -9,6 +11,9 @@
 #include "../assets.h"
 #include "../controlTags.h"
 #include "../controlMessageTags.h"
+#include "../enums.h"
+#include "../normalization.h"
+#include "../tripleBuffer.h"
 using namespace iplug;
 using namespace igraphics;
 
@@ -46,8 +51,11 @@ private:
   // Maximum value this ModulatedParameter can take.
   float maxValue;
 
-  // Indices in the array of all modulation links that are connected to this parameter.
-  std::set<int> modIndices;
+  // Indices in the array of all modulation links that are connected to this parameter, in
+  // ascending order. Every LFO can connect at most one of its links to a parameter, so there
+  // can not be more than MAX_NUMBER_LFOS indices. Only the first numModulators entries are valid.
+  int modIndices[MAX_NUMBER_LFOS] = {};
+  int numModulators = 0;
 
   // Keeps track if any of the available LFOs is connected to this parameter.
   // In principle this is also evident from modIndices, but requires more computational
@@ -69,6 +77,12 @@ public:
   // Adds the indices of all LFO links connected to this parameter to the given set.
   void getModulators(std::set<int>& mods) const;
 
+  // * @return The number of LFO links connected to this parameter.
+  int getNumModulators() const;
+
+  // * @return The index of the k-th LFO link connected to this parameter, in ascending order.
+  int getModulator(int k) const;
+
   // * @return true if this parameter is already connected to the LFO with given index.
   bool isConnectedToLFO(int LFOIdx) const;
 
@@ -133,8 +147,14 @@ public:
   Shapes mode = shapePower;
 
   // Relative y-value of the curve at the x-center point between this and the previous point.
+  // Must be changed through setCurveCenter or updateCurveCenter to keep power up to date.
   ModulatedParameter curveCenterPosY;
 
+  // Power of the curve segment corresponding to the unmodulated curveCenterPosY. A negative
+  // value indicates that the curve is mirrored, see getPowerFromPosY.
+  // Cached because it requires two calls to log.
+  float power = 1;
+
   // The curve center y-position at the last left click.
   float centerYClicked = 0;
 
@@ -181,6 +201,9 @@ public:
   // the unmmodulated value is returned.
   float getCurveCenterAbsPosY(float previousY, double* modulationAmplitudes = nullptr) const;
 
+  // Sets the unmodulated curve center y-position and updates power.
+  void setCurveCenter(float y);
+
   // Update the Curve center point when manually dragging it.
   //
   // * @param y Absolute y-position of the mouse cursor
@@ -197,6 +220,209 @@ public:
   int unserializeState(const IByteChunk& chunk, int startPos, int version);
 };
 
+// Precomputed values of a shaping function on [0, 1].
+//
+// The interval is split into cells at the x-positions of the points and at LOOKUP_TABLE_CELLS
+// equally spaced positions. Inside a cell the function is smooth, so every cell holds its own
+// table with a resolution chosen such that interpolating it stays within a maximum error of the
+// exact curve. Cells of flat segments only need a few entries, while closely spaced points and
+// steep segments get a fine resolution.
+// Cells are found with an index of LOOKUP_TABLE_CELLS equally sized buckets, which stores the
+// first cell overlapping each bucket.
+struct CurveLookupTable
+{
+  // Interpolation used between the table entries. lookupNone if the table is not in use.
+  curveLookupMode mode = lookupNone;
+
+  // Index of the first cell that overlaps each bucket.
+  std::vector<int> bucketCells;
+
+  // Lower and upper x-position of the cells.
+  std::vector<float> cellStarts;
+  std::vector<float> cellEnds;
+
+  // Number of table intervals per unit x of each cell.
+  std::vector<float> cellScales;
+
+  // Index of the entry belonging to the start of each cell in values.
+  std::vector<int> cellOffsets;
+
+  // Number of intervals the table of each cell is divided into.
+  std::vector<int> cellSizes;
+
+  // Values of the function. With cubic interpolation, every cell table has one additional
+  // entry on each side, which is extrapolated linearly from inside the cell.
+  std::vector<float> values;
+
+  // * @return true if the table can be used to evaluate the function.
+  bool isValid() const { return mode != lookupNone; }
+
+  // Interpolates the table at input. Input must be in [0, 1].
+  float lookup(float input) const;
+
+  // Invalidates the table and removes all entries. The vectors keep their capacity.
+  void clear();
+};
+
+// Remembers the curve segment found by the last evaluation of a CompiledCurve.
+//
+// Consecutive audio samples are usually close to each other and mostly belong to the same
+// or a neighboring segment. CompiledCurve::forward checks these first before falling back
+// to a binary search. Every audio channel evaluating a curve should use its own cursor.
+struct CurveCursor
+{
+  // Index of the point at the upper end of the last segment.
+  int idx = 1;
+};
+
+struct ResolvedCurve;
+
+// Flat representation of the function defined by the ShapePoints of a ShapeEditor.
+//
+// ShapePoints carry a lot of data that is only needed by the UI (IRECTs, LFO connection
+// flags, click states), so evaluating the function directly on them pulls cold data into
+// the cache on every step of the segment search. A CompiledCurve stores only what is
+// required to evaluate the function, as structure-of-arrays. It is rebuilt by
+// ShapeEditor::compileCurve whenever the curve changes and is what the audio thread reads.
+//
+// Entry i of every array belongs to shapePoints[i], i.e. it describes the point i and the
+// curve segment between point i - 1 and point i.
+struct CompiledCurve
+{
+  // Unmodulated relative x-positions of the points.
+  std::vector<float> x;
+
+  // Unmodulated relative y-positions of the points.
+  std::vector<float> y;
+
+  // Unmodulated curve center y-positions of the segments.
+  std::vector<float> centerY;
+
+  // Power of the segments as returned by getPowerFromPosY. A negative value indicates
+  // that the curve is mirrored, see ShapeEditor::forward. Copied from ShapePoint::power.
+  std::vector<float> power;
+
+  // Reciprocal of the unmodulated x-extent of the segments, 0 for segments without extent.
+  std::vector<float> invXExtent;
+
+  // Interpolation mode of the segments.
+  std::vector<Shapes> mode;
+
+  // Non-zero if the x-position of the point is modulated. Stored as char instead of bool to
+  // avoid the bit-packed std::vector<bool> specialization.
+  std::vector<char> isXModulated;
+
+  // Modulation links of all modulated parameters in compressed sparse row format.
+  // The links of the parameter of point i with modulationMode m are stored in
+  // links[linkOffsets[k]] to links[linkOffsets[k + 1] - 1], with k = getLinkSlot(i, m).
+  std::vector<int> linkOffsets;
+  std::vector<int> links;
+
+  // True if any segment uses an interpolation mode other than shapePower. These curves
+  // can not be evaluated by the SIMD kernel.
+  bool hasSineSegments = false;
+
+  // Lookup table of the unmodulated function. Only valid if no parameter is modulated.
+  CurveLookupTable lookupTable;
+
+  // Indices of the points with at least one modulated parameter, in ascending order.
+  std::vector<int> modulatedPoints;
+
+  // For every entry of modulatedPoints, the index of the next point at a higher or equal x
+  // that is not modulated in x-direction. Modulated points can not be pushed past it.
+  std::vector<int> upperFixedPoints;
+
+  // Incremented every time the curve is compiled.
+  unsigned int revision = 0;
+
+  // * @return The number of points in this curve, including the fixed point at (0, 0).
+  int size() const { return static_cast<int>(x.size()); }
+
+  // * @return Index into linkOffsets of the given parameter of point i.
+  static int getLinkSlot(int i, modulationMode m) { return 3 * i + (m - modCurveCenterY); }
+
+  // Returns the modulated value of a parameter of point i clamped to [minValue, maxValue].
+  // Equivalent to ModulatedParameter::get.
+  float getModulated(int i, modulationMode m, float base, double* modulationAmplitudes, float minValue, float maxValue) const;
+
+  // Returns the relative x-position of point i, see ShapePoint::getPosX.
+  float getPosX(int i, double* modulationAmplitudes = nullptr, float lowerBound = 0.f, float upperBound = 1.f) const;
+
+  // Returns the relative y-position of point i, see ShapePoint::getPosY.
+  float getPosY(int i, double* modulationAmplitudes = nullptr) const;
+
+  // * @return true if any parameter of this curve is connected to a modulation link.
+  bool isModulated() const { return !links.empty(); }
+
+  // Evaluates the curve at input. See ShapeEditor::forward.
+  // * @param cursor Optional cursor that speeds up the segment search for correlated inputs
+  float forward(float input, double* modulationAmplitudes = nullptr, CurveCursor* cursor = nullptr) const;
+
+  // Evaluates the curve on a block of samples. See ShapeEditor::forwardBlock.
+  // * @param cursor Optional cursor that speeds up the segment search for correlated inputs
+  // * @param norms Optional normalizer of each sample. The inputs are normalized before and the
+  // outputs reverted after the evaluation.
+  void forwardBlock(const iplug::sample* input, iplug::sample* output, int n, double* modulationAmplitudes = nullptr, CurveCursor* cursor = nullptr, const POINormalizer* norms = nullptr) const;
+
+  // Computes the positions and powers of all points at the given modulation amplitudes.
+  //
+  // Points modulated in x-direction push modulated points at higher x to the right, but can
+  // not move past unmodulated points. These are the same rules ShapeEditorControl::Draw uses.
+  // Only the modulated points are updated unless the curve has been recompiled since the last
+  // call with the same ResolvedCurve. Does not allocate for curves of up to MAX_SHAPE_POINTS points.
+  // * @param modulationAmplitudes Array of the amplitudes of all LFO modulation links, see forward
+  // * @param resolved Storage for the result
+  void resolve(double* modulationAmplitudes, ResolvedCurve& resolved) const;
+
+  // Rebuilds lookupTable from the exact curve.
+  //
+  // Chooses the resolution of every table cell such that the interpolated values are within
+  // maxError of the exact function. If this is not possible within LOOKUP_TABLE_MAX_SIZE entries
+  // or if the curve is modulated, the table is not used.
+  // * @param mode The interpolation used between table entries. lookupNone disables the table.
+  // * @param maxError Maximum absolute error of interpolated values
+  void buildLookupTable(curveLookupMode mode, float maxError);
+};
+
+// A CompiledCurve at fixed modulation amplitudes, see CompiledCurve::resolve.
+//
+// Since all points have a fixed position, the segment of an input can be found with a binary
+// search, even if points are modulated in x-direction. Resolving once per modulation update
+// avoids walking islands of x-modulated points for every sample.
+struct ResolvedCurve
+{
+  // The CompiledCurve and its revision these values have been resolved from.
+  const CompiledCurve* source = nullptr;
+  unsigned int revision = 0;
+
+  // Modulated relative positions of the points.
+  std::vector<float> x;
+  std::vector<float> y;
+
+  // Modulated power of the segments, see CompiledCurve::power.
+  std::vector<float> power;
+
+  // Reciprocal of the modulated x-extent of the segments.
+  std::vector<float> invXExtent;
+
+  // Interpolation mode of the segments.
+  std::vector<Shapes> mode;
+
+  // Reserves storage for MAX_SHAPE_POINTS points, so resolving does not allocate on the audio thread.
+  ResolvedCurve();
+
+  // * @return The number of points in this curve, including the fixed point at (0, 0).
+  int size() const { return static_cast<int>(x.size()); }
+
+  // Evaluates the curve at input. See ShapeEditor::forward.
+  // * @param cursor Optional cursor that speeds up the segment search for correlated inputs
+  float forward(float input, CurveCursor* cursor = nullptr) const;
+
+  // Evaluates the curve on a block of samples.
+  // * @param cursor Optional cursor that speeds up the segment search for correlated inputs
+  void forwardBlock(const iplug::sample* input, iplug::sample* output, int n, CurveCursor* cursor = nullptr) const;
+};
+
 // A graph editor that can be used to design functions on the user interface.
 // The function defined is a mapping from [0, 1] to [0, 1] which is accessible through
 // the forward() method.
@@ -216,6 +442,25 @@ class ShapeEditor
   // Stores the modulation link indices of the most recently deleted point.
   std::vector<int> deletedLinks = {};
 
+  // Flat copy of shapePoints that is used to evaluate the function on the UI thread.
+  CompiledCurve compiledCurve;
+
+  // Copies of compiledCurve that are handed to the audio thread without locks. Held by pointer,
+  // since the atomic index makes the TripleBuffer immovable.
+  std::unique_ptr<TripleBuffer<CompiledCurve>> snapshots = std::make_unique<TripleBuffer<CompiledCurve>>();
+
+  // Interpolation mode of the lookup table used for the unmodulated function.
+  curveLookupMode lookupMode = lookupLinear;
+
+  // Maximum error of the lookup table.
+  float lookupMaxError = LOOKUP_TABLE_MAX_ERROR;
+
+  // true if the curve has been compiled since the lookup table was last built.
+  bool lookupTablePending = false;
+
+  // Copies compiledCurve into the back buffer of snapshots and publishes it.
+  void publishCompiledCurve();
+
   public:
   // Stores the box coordinates of GUI elements of this ShapeEditor instance.
   ShapeEditorLayout layout;
@@ -309,6 +554,44 @@ class ShapeEditor
   // point to an array of size MAX_NUMBER_LFOS * MAX_MODULATION_LINKS.
   float forward(float input, double* modulationAmplitudes = nullptr) const;
 
+  // Passes a block of samples to the function defined by the graph.
+  //
+  // Gives the same result as calling forward on every sample, but evaluates unmodulated
+  // curves with SIMD instructions if available. The modulation amplitudes are treated as
+  // constant over the whole block.
+  // * @param input Pointer to n input samples
+  // * @param output Pointer to storage for n output samples. May be equal to input.
+  // * @param n The number of samples to process
+  // * @param modulationAmplitudes Array of the amplitudes of all LFO modulation links, see forward.
+  void forwardBlock(const iplug::sample* input, iplug::sample* output, int n, double* modulationAmplitudes = nullptr) const;
+
+  // Rebuilds the CompiledCurve from shapePoints.
+  //
+  // Must be called after every change of the ShapePoints, including their modulation links,
+  // else the change will not be audible.
+  void compileCurve();
+
+  // Builds the lookup table of the CompiledCurve if the curve has changed and publishes it.
+  //
+  // Building the table is too expensive to repeat on every mouse drag event, so compileCurve
+  // only marks it as outdated and the audio thread evaluates the exact curve until this is
+  // called. Does nothing while the user is dragging a point. LFO editors never build a table,
+  // since they are only evaluated to bake their wavetables.
+  void refreshLookupTable();
+
+  // Sets how the unmodulated function is evaluated and rebuilds the CompiledCurve.
+  // * @param mode lookupNone to always evaluate the curve exactly, else the interpolation
+  // used by the lookup table
+  // * @param maxError Maximum absolute error of the lookup table
+  void setLookupMode(curveLookupMode mode, float maxError = LOOKUP_TABLE_MAX_ERROR);
+
+  // * @return The CompiledCurve of this editor. Must only be used on the UI thread.
+  const CompiledCurve& getCompiledCurve() const;
+
+  // * @return The most recent CompiledCurve published to the audio thread, see TripleBuffer::acquire.
+  // Must only be called on the audio thread.
+  const CompiledCurve& acquireCompiledCurve();
+
   // Attach the ShapeEditor UI to the given graphics context.
   //
   // This will create
@@ -324,6 +607,7 @@ class ShapeEditor
   void getLinks(std::set<int>& links);
 
   // Adds a new ShapePoint at x, y to shapePoints and fixedPoints.
+  // Must not be called if the editor already has MAX_SHAPE_POINTS points.
   // The point is added such that shapePoints is ordered with respect to the
   // x-position of the points.
   // * @return The index of the new point in shapePoints.
@@ -388,6 +672,14 @@ protected:
 
   std::vector<float> mPoints;
 
+  // Evenly spaced x-values at which the function is sampled to draw the graph, and storage
+  // for the corresponding function values.
+  std::vector<iplug::sample> mInputs;
+  std::vector<iplug::sample> mOutputs;
+
+  // The curve of the editor at the current UI modulation amplitudes.
+  ResolvedCurve mResolved;
+
   ShapeEditor* editor = nullptr;
   IRECT editorRect;
 
@@ -12,4 +12,8 @@ void TopMenuBar::attachUI(IGraphics* pGraphics) {
   pGraphics->AttachControl(new ITextControl(layout.menuTitleRect, "Distortion mode", IText(UDS_TEXT_SIZE)));
   pGraphics->AttachControl(new ICaptionControl(layout.modeMenuRect, distMode, IText(UDS_TEXT_SIZE), DEFAULT_FGCOLOR, false), EControlTags::modeMenu);
   pGraphics->AttachControl(new IVSwitchControl(layout.normalizeButtonRect, EParams::normalize, "normalize input"), EControlTags::normalizeSwitch);
+  pGraphics->AttachControl(new ITextControl(layout.rateTitleRect, "Modulation rate", IText(UDS_TEXT_SIZE)));
+  pGraphics->AttachControl(new ICaptionControl(layout.rateMenuRect, EParams::modRate, IText(UDS_TEXT_SIZE), DEFAULT_FGCOLOR, false), EControlTags::modRateMenu);
+  pGraphics->AttachControl(new ITextControl(layout.interpolationTitleRect, "Interpolation", IText(UDS_TEXT_SIZE)));
+  pGraphics->AttachControl(new ICaptionControl(layout.interpolationMenuRect, EParams::modInterpolation, IText(UDS_TEXT_SIZE), DEFAULT_FGCOLOR, false), EControlTags::modInterpolationMenu);
 }
\ No newline at end of file
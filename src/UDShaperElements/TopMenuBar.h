@@ -28,5 +28,7 @@ class TopMenuBar
   // This will create
   // - the UDShaper logo (TODO).
   // - the popup menu to select the distortion mode.
+  // - the button to toggle input normalization.
+  // - the popup menus to select the modulation rate and interpolation.
   void attachUI(IGraphics* pGraphics);
 };
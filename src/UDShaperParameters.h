@@ -34,8 +34,23 @@ enum EParams
   // Each link has one parameter corresponding to the amplitude.
   modStart = LFOsStart + MAX_NUMBER_LFOS * kNumLFOParams,
 
+  // Number of samples between two evaluations of the LFOs, see MODULATION_RATES.
+  modRate = modStart + MAX_NUMBER_LFOS * MAX_MODULATION_LINKS,
+
+  // Interpolation of the shaping functions between two evaluations of the LFOs.
+  modInterpolation,
+
+  // Minimum level change for a POI of the piecewise normalization.
+  normalizeHysteresis,
+
+  // Lowest frequency covered by the lookahead of the piecewise normalization.
+  normalizeFrequency,
+
+  // Strategy of the piecewise normalization, see normalizationMode.
+  normalizeMode,
+
   // Total number of parameters.
-  kNumParams = modStart + MAX_NUMBER_LFOS * MAX_MODULATION_LINKS
+  kNumParams
 };
 
 // Returns the global parameter index of LFO parameters.
@@ -41,9 +41,63 @@ constexpr int MAX_MODULATION_LINKS = 10;
 // Default text size for labels, values, etc.
 constexpr float UDS_TEXT_SIZE = 22.f;
 
-// Latency in samples used for piecewise normalization.
-// 674 samples is one period of a C2 note (65.41 Hz) at a sample
-// rate of 44100 Hz. For sine waves, this can be
-// sufficient to distort signals down to C0 (16.35 Hz), in general
+// Lowest frequency in Hz covered by the lookahead used for piecewise normalization.
+// The lookahead (and latency) is one period of this frequency. The default of a C2
+// note (65.41 Hz) results in 674 samples at a sample rate of 44100 Hz. For sine waves,
+// this can be sufficient to distort signals down to C0 (16.35 Hz), in general
 // this depends on the waveform and number of extrema per cycle.
-constexpr int LATENCY_NORMALIZE = 674;
\ No newline at end of file
+constexpr double NORMALIZE_FREQUENCY_DEFAULT = 65.41;
+
+// Range of the lowest frequency covered by the normalization lookahead in Hz. The
+// buffers are allocated for the minimum, so changing the frequency never allocates.
+constexpr double NORMALIZE_FREQUENCY_MIN = 10.;
+constexpr double NORMALIZE_FREQUENCY_MAX = 2000.;
+
+// Number of samples ProcessBlock processes at once. The host buffer is split into
+// chunks of this size, which are normalized, shaped and written to the output in
+// separate passes.
+constexpr int PROCESS_CHUNK_SIZE = 64;
+
+// Maximum number of points of a shaping function, including the fixed point at (0, 0).
+// Storage that is filled on the audio thread is reserved for this many points.
+constexpr int MAX_SHAPE_POINTS = 256;
+
+// Maximum absolute error of shaping function lookup tables compared to the exact curve.
+// Lookup tables that can not reach this accuracy are not used.
+constexpr float LOOKUP_TABLE_MAX_ERROR = 1E-5f;
+
+// Number of equally sized cells a lookup table is divided into. Each cell chooses its own
+// resolution, so steep parts of the curve get more table entries than flat parts.
+constexpr int LOOKUP_TABLE_CELLS = 64;
+
+// Maximum number of intervals inside a single lookup table cell.
+constexpr int LOOKUP_TABLE_MAX_CELL_SIZE = 4096;
+
+// Maximum total number of entries of a lookup table.
+constexpr int LOOKUP_TABLE_MAX_SIZE = 65536;
+
+// Selectable numbers of samples between two evaluations of the LFOs. The first option
+// evaluates the LFOs for every sample.
+constexpr int MODULATION_RATES[5] = {1, 8, 16, 32, 64};
+
+// Maximum difference in beats or seconds between the host position and the position of the
+// LFO phase accumulators before the phases are seeded from the host position again.
+constexpr double LFO_CLOCK_TOLERANCE = 1E-6;
+
+// Number of entries of the wavetables LFO curves are baked into.
+constexpr int LFO_WAVETABLE_SIZE = 2048;
+
+// Number of curve values averaged for every LFO wavetable entry.
+constexpr int LFO_WAVETABLE_OVERSAMPLING = 8;
+
+// Release time of the peak tracker of the predictive normalization, in periods of the
+// lowest normalized frequency (see NORMALIZE_FREQUENCY_DEFAULT).
+constexpr double NORMALIZE_PREDICTOR_RELEASE = 10.;
+
+// Maximum number of sample-accurate parameter changes per block. Further changes are
+// applied at the start of the next block.
+constexpr int PARAM_EVENT_CAPACITY = 256;
+
+// Levels below this are flushed to zero in recursive state, such as decaying peaks, so it
+// never becomes subnormal. About -600 dB, far below any audible signal.
+constexpr double DENORMAL_LEVEL = 1e-30;
\ No newline at end of file
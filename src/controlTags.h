@@ -5,6 +5,8 @@ enum EControlTags
 {
   modeMenu = 0,
   normalizeSwitch,
+  modRateMenu,
+  modInterpolationMenu,
   ShapeEditorControl1,
   ShapeEditorControl2,
   LFOSelectorControlTag,
@@ -32,3 +32,50 @@ enum modulationMode{
     // Modulation changes the y-position of the modulated ShapePoint.
     modPosY
 };
+
+// Ways to evaluate a shaping function that is not modulated.
+enum curveLookupMode
+{
+  // Evaluate the curve segments exactly.
+  lookupNone,
+
+  // Interpolate linearly between values of a precomputed table.
+  lookupLinear,
+
+  // Interpolate between values of a precomputed table with cubic Catmull-Rom splines.
+  lookupCubic
+};
+
+// Interpolation of modulated shaping functions between two modulation updates.
+enum modulationSmoothing
+{
+  // Crossfade linearly from the previous to the next update.
+  smoothingLinear,
+
+  // Crossfade with a smoothstep function, which has zero slope at both updates.
+  smoothingSmoothstep
+};
+
+
+// Strategies of the piecewise normalization.
+enum normalizationMode
+{
+  // Buffer the audio and normalize to the exact POIs, which adds latency.
+  normalizeLookahead,
+
+  // Estimate the next POI from the previous extrema, which adds no latency.
+  normalizePredictive
+};
+
+// Kinds of POIs (points of interest) found by SampleState::detect.
+enum POIType
+{
+  // The sample does not complete a POI.
+  noPOI,
+
+  // The audio changed direction at an extremum.
+  directionPOI,
+
+  // The audio changed sign.
+  signPOI
+};
@@ -0,0 +1,462 @@
+// Building blocks of the piecewise normalization.
+//
+// Piecewise normalization scales the audio between two neighbouring 'points of interest' (POIs)
+// to [0, 1] or [-1, 0] before it is passed to the shaping functions. POIs are samples that are
+// either minima, maxima or zero points.
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include "IPlugConstants.h"
+#include "config.h"
+#include "enums.h"
+#include "ringBuffer.h"
+#include "simd.h"
+
+// Lookahead of the piecewise normalization in samples, one period of the given frequency.
+inline int getLookaheadSamples(double sampleRate, double frequency)
+{
+  return std::max(static_cast<int>(std::lround(sampleRate / frequency)), 1);
+}
+
+// Stores two POI levels and normalizes samples to their interval.
+//
+// The coefficients are computed once per POI in setNextLevel, such that normalizing and
+// reverting a sample is a single multiply-add without branches.
+struct POINormalizer
+{
+  // Set the value of the next POI.
+  void setNextLevel(iplug::sample newLevel)
+  {
+    levelPrev = levelNext;
+    levelNext = newLevel;
+
+    increasing = levelPrev < levelNext;
+
+    range = levelNext - levelPrev;
+    range = (range > 0) ? range : -range;
+
+    iplug::sample absolutePrev = (levelPrev > 0) ? levelPrev : -levelPrev;
+    iplug::sample absoluteNext = (levelNext > 0) ? levelNext : -levelNext;
+    offset = (absolutePrev < absoluteNext) ? levelPrev : levelNext;
+
+    // Samples are passed through unchanged if both POIs are equal. Ranges below
+    // DENORMAL_LEVEL are treated as equal, since their inverse would overflow.
+    if (range < DENORMAL_LEVEL)
+    {
+      range = 1.;
+      offset = 0.;
+    }
+    inverseRange = 1. / range;
+  }
+
+  // Set the values of both POIs.
+  void setLevels(iplug::sample previousLevel, iplug::sample nextLevel)
+  {
+    levelNext = previousLevel;
+    setNextLevel(nextLevel);
+  }
+
+  // Normalize a sample to the current POI range. The sign is preserved,
+  // i.e. ouput is either in [-1, 0] or [0, 1].
+  // * @param input Input value, should be within the current POI range
+  // * @return The value of the input sample normalized to the POI range
+  iplug::sample normalize(iplug::sample input) const
+  {
+    return (input - offset) * inverseRange;
+  }
+
+  // * @param input Sample normalized to [0, 1] or [-1, 0]
+  // * @return The value of a normalized sample scaled back to the POI range
+  iplug::sample revertNormalize(iplug::sample input) const
+  {
+    return input * range + offset;
+  }
+
+  bool isIncreasing() const
+  {
+    return increasing;
+  }
+
+private:
+  iplug::sample levelPrev = 0.;
+  iplug::sample levelNext = 0.;
+
+  // Distance between the POIs, the level closer to zero and 1 / range.
+  // Set to 1, 0 and 1 if the POIs are equal.
+  iplug::sample range = 1.;
+  iplug::sample offset = 0.;
+  iplug::sample inverseRange = 1.;
+  bool increasing = false;
+};
+
+// Stores information regarding the state of a single sample.
+// Contains flags to indicate if the sample is on a positive segment of
+// audio, if the audio is increasing at this sample and the level of the
+// previous sample.
+struct SampleState
+{
+  // Indicates if the sample is on a positive segment. This can be true
+  // even if the audio is zero, in which case it means that the previous
+  // samples were all >= zero. This must be tracked to correctly detect
+  // points at which the sign changes.
+  bool isPositive = false;
+
+  bool isIncreasing = false;
+  iplug::sample previousLevel = 0.;
+
+  // Most extreme level in the current direction since the last POI and the number of
+  // samples that have passed since, excluding the most recent sample.
+  iplug::sample extremumLevel = 0.;
+  int extremumAge = 0;
+
+  // Checks if a new sample completes a POI and updates the sign and direction.
+  //
+  // Samples that are zero do not need to be normalized and can be excluded
+  // from sign/ direction evaluation.
+  // A change is only detected once the audio has moved more than hysteresis
+  // away from the last extremum or from zero.
+  // Must be followed by track with the same sample.
+  // * @param level The new sample
+  // * @param hysteresis Minimum level change for a POI
+  // * @param POILevel Set to the level of the POI if one is found. A directionPOI lies
+  // extremumAge samples before the previous sample, a signPOI at the previous sample.
+  POIType detect(iplug::sample level, iplug::sample hysteresis, iplug::sample& POILevel)
+  {
+    bool signChange = (previousLevel != 0) && (isPositive ? (level <= -hysteresis) : (level > hysteresis));
+    bool directionChange = isIncreasing ? (level < extremumLevel - hysteresis) : (level > extremumLevel + hysteresis);
+
+    // Points can have both a change in sign and direction (e.g. at points
+    // where a saw wave jumps). If this happens, the level of the extremum is
+    // the POI level. If only the sign changes, the POI level is zero.
+    if (directionChange)
+    {
+      POILevel = extremumLevel;
+      isIncreasing = !isIncreasing;
+      isPositive = level > 0;
+      extremumLevel = level;
+      return directionPOI;
+    }
+    else if (signChange)
+    {
+      POILevel = 0.;
+      isPositive = !isPositive;
+      extremumLevel = level;
+      return signPOI;
+    }
+    return noPOI;
+  }
+
+  // Tracks the extremum of the current segment. Of several equal levels, the latest is used.
+  // * @param level The sample passed to detect
+  // * @param maxAge Upper bound of extremumAge
+  void track(iplug::sample level, int maxAge)
+  {
+    if (isIncreasing ? (level >= extremumLevel) : (level <= extremumLevel))
+    {
+      extremumLevel = level;
+      extremumAge = 0;
+    }
+    else if (extremumAge < maxAge)
+    {
+      extremumAge++;
+    }
+
+    previousLevel = level;
+  }
+
+  // Equivalent to detect followed by track for the given number of zero samples, if the
+  // previous sample has been zero and the hysteresis has not changed since. A zero sample
+  // after a zero sample can not complete a POI.
+  // * @param maxAge Upper bound of extremumAge
+  void advanceSilence(int samples, int maxAge)
+  {
+    if (isIncreasing ? (0. >= extremumLevel) : (0. <= extremumLevel))
+    {
+      extremumLevel = 0.;
+      extremumAge = 0;
+    }
+    else
+    {
+      extremumAge = std::min(extremumAge + samples, std::max(extremumAge, maxAge));
+    }
+  }
+
+  // Equivalent to detect followed by track for samples that findPOICandidates has ruled out.
+  // * @param level The new sample
+  void advance(iplug::sample level)
+  {
+    extremumLevel = level;
+    extremumAge = 0;
+    previousLevel = level;
+  }
+};
+
+static_assert(PROCESS_CHUNK_SIZE <= 64, "findPOICandidates returns one bit per sample of a chunk");
+
+// Finds the samples of a chunk that may complete a POI. Only these must be passed to
+// SampleState::detect, all others can be passed to SampleState::advance.
+//
+// Without hysteresis, a sample can not complete a POI if it and the two samples before it
+// have the same sign and the audio moves in the same direction over all three. The state
+// is then known without evaluating it: the extremum is the previous sample. The first two
+// samples of a chunk and all samples with hysteresis are always candidates.
+// Products that underflow to zero only add candidates, so the result is exact.
+// * @param levels n samples of one channel, n <= PROCESS_CHUNK_SIZE
+// * @param hysteresis Minimum level change for a POI, see SampleState::detect
+// * @return Bit i is set if levels[i] is a candidate
+inline uint64_t findPOICandidates(const iplug::sample* levels, int n, iplug::sample hysteresis)
+{
+  uint64_t all = (n < 64) ? ((uint64_t(1) << n) - 1) : ~uint64_t(0);
+  if ((hysteresis != 0.) || (n <= 2))
+  {
+    return all;
+  }
+
+  // Set the bits of samples that can be skipped.
+  uint64_t skip = 0;
+  int i = 2;
+
+#if defined(UDS_SIMD) && !defined(SAMPLE_TYPE_FLOAT)
+  SIMDDouble zero = simdDoubleZero();
+  for (; i + SIMD_DOUBLE_WIDTH <= n; i += SIMD_DOUBLE_WIDTH)
+  {
+    SIMDDouble level2 = simdDoubleLoad(levels + i - 2);
+    SIMDDouble level1 = simdDoubleLoad(levels + i - 1);
+    SIMDDouble level0 = simdDoubleLoad(levels + i);
+
+    SIMDDouble sameSign = simdDoubleAnd(simdDoubleGreater(simdDoubleMul(level2, level1), zero),
+                                        simdDoubleGreater(simdDoubleMul(level1, level0), zero));
+    SIMDDouble sameDirection = simdDoubleGreater(simdDoubleMul(simdDoubleSub(level1, level2), simdDoubleSub(level0, level1)), zero);
+    skip |= static_cast<uint64_t>(simdDoubleMoveMask(simdDoubleAnd(sameSign, sameDirection))) << i;
+  }
+#endif
+
+  for (; i < n; i++)
+  {
+    bool sameSign = (levels[i - 2] * levels[i - 1] > 0) && (levels[i - 1] * levels[i] > 0);
+    bool sameDirection = (levels[i - 1] - levels[i - 2]) * (levels[i] - levels[i - 1]) > 0;
+    if (sameSign && sameDirection)
+    {
+      skip |= uint64_t(1) << i;
+    }
+  }
+
+  return all & ~skip;
+}
+
+// The POIs of one channel between the back and the front of the lookahead buffer.
+//
+// Samples are searched for POIs when they are pushed to the back of the buffer and the queues
+// are consumed when the samples leave the buffer at the front, latency samples later.
+struct POIQueue
+{
+  // The level of samples at POIs in the buffer.
+  RingBuffer<iplug::sample> levels;
+
+  // The position of POIs in the buffer. Each entry corresponds to one POI
+  // and gives the relative offset in samples from the previous POI.
+  RingBuffer<int> offsets;
+
+  // State of the sample at the back of the buffer.
+  SampleState backSample;
+
+  // The number of samples passed since the last POI has been found.
+  int offsetCount = 0;
+
+  // The number of POIs found in the last chunk up to and including each sample.
+  int found[PROCESS_CHUNK_SIZE] = {};
+
+  // Allocates the queues for a buffer holding up to maxLatency samples plus one chunk and clears them.
+  void allocate(int maxLatency)
+  {
+    // Every sample completes at most one POI, so the queues hold at most one POI per buffered
+    // sample, plus the POI at the start of the segment the front sample belongs to. Allocated
+    // for the worst case, the queues can not overflow, even on noise without hysteresis.
+    int capacity = maxLatency + PROCESS_CHUNK_SIZE + 2;
+    levels.allocate(capacity);
+    offsets.allocate(capacity);
+  }
+
+  void clear()
+  {
+    levels.clear();
+    offsets.clear();
+  }
+
+  // Appends a POI to the queues. The queues must not be full, see allocate.
+  // * @param level The level of the sample at the POI
+  // * @param offset The offset in samples from the previous POI
+  void add(iplug::sample level, int offset)
+  {
+    // POIs must never be merged or dropped: they alternate between minima, zero crossings and
+    // maxima, and every sample between two POIs lies in the range of their levels. Combining two
+    // POIs breaks this and normalizes samples outside of [-1, 1], where the shaping functions
+    // are not defined.
+    assert(!offsets.full() && !levels.full());
+
+    levels.push(level);
+    offsets.push(offset);
+  }
+
+  // Checks if a new sample at the back of the buffer completes a POI and adds it to the queues.
+  // * @param level The new sample
+  // * @param hysteresis Minimum level change for a POI, see SampleState::detect
+  // * @param latency Lookahead in samples
+  void detect(iplug::sample level, iplug::sample hysteresis, int latency)
+  {
+    int extremumAge = backSample.extremumAge;
+    iplug::sample POILevel = 0.;
+    POIType type = backSample.detect(level, hysteresis, POILevel);
+
+    if (type == directionPOI)
+    {
+      // The POI is at the extremum, which may lie a few samples back.
+      int shift = std::min(extremumAge, offsetCount);
+      add(POILevel, offsetCount - shift);
+      offsetCount = shift;
+    }
+    else if (type == signPOI)
+    {
+      add(POILevel, offsetCount);
+      offsetCount = 0;
+    }
+
+    // Count the samples since the last POI.
+    // The offset can not be larger than the buffer size.
+    if (offsetCount < latency)
+    {
+      offsetCount++;
+    }
+
+    backSample.track(level, latency);
+  }
+
+  // Checks n new samples at the back of the buffer for POIs and adds them to the queues.
+  // Only the candidates of findPOICandidates are passed to detect. Sets found.
+  // * @param samples The new samples, n <= PROCESS_CHUNK_SIZE
+  void detectChunk(const iplug::sample* samples, int n, iplug::sample hysteresis, int latency)
+  {
+    uint64_t candidates = findPOICandidates(samples, n, hysteresis);
+    int sizeBefore = offsets.size();
+
+    for (int i = 0; i < n; i++)
+    {
+      if ((candidates >> i) & 1)
+      {
+        detect(samples[i], hysteresis, latency);
+      }
+      else
+      {
+        backSample.advance(samples[i]);
+        if (offsetCount < latency)
+        {
+          offsetCount++;
+        }
+      }
+      found[i] = offsets.size() - sizeBefore;
+    }
+  }
+
+  // Moves the front of the buffer by one sample and sets norm to the next POI once it is reached.
+  // The samples of the last chunk after i have already been searched for POIs. They are ignored,
+  // such that the result is the same as loading one sample at a time.
+  // * @param i Index of the front sample in the last chunk passed to detectChunk
+  // * @param n Size of that chunk
+  // * @return True if the level of norm has changed
+  bool advanceFront(int i, int n, POINormalizer& norm)
+  {
+    int knownPOIs = offsets.size() - (found[n - 1] - found[i]);
+
+    // Count down until the next POI is reached.
+    if ((knownPOIs > 0) && --offsets.front() <= 0)
+    {
+      // The level of the next POI is the second element in levels.
+      if (knownPOIs > 1)
+      {
+        norm.setNextLevel(levels.at(1));
+        levels.pop();
+        offsets.pop();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Equivalent to pushing n zeros to the back and advancing the front by n samples, if the buffer
+  // only holds zeros and at most one POI is queued.
+  void advanceSilence(int n, int latency)
+  {
+    backSample.advanceSilence(n, latency);
+    offsetCount = std::min(offsetCount + n, latency);
+    if (!offsets.empty())
+    {
+      offsets.front() = std::max(offsets.front() - n, 0);
+    }
+  }
+};
+
+// Normalizes audio without lookahead by predicting the next POI.
+//
+// The previous POI of a sample is known, only the next one must be estimated. If the audio
+// moves towards zero, the next POI is assumed to be the zero crossing. If it moves away from
+// zero, the next POI is estimated by a peak tracker that holds the largest recent extremum of
+// the same sign and decays over time to follow falling levels. If the audio exceeds the
+// estimate, the current level is used instead, so normalized samples never leave [-1, 1].
+struct POIPredictor
+{
+  // Processes the next sample and sets norm to the estimated POI range.
+  // * @param level The new sample
+  // * @param hysteresis Minimum level change for a POI, see SampleState::detect
+  // * @param decay Factor applied to the previous extrema per sample
+  void process(iplug::sample level, iplug::sample hysteresis, iplug::sample decay, POINormalizer& norm)
+  {
+    iplug::sample POILevel = 0.;
+    POIType type = state.detect(level, hysteresis, POILevel);
+    if (type != noPOI)
+    {
+      lastLevel = POILevel;
+    }
+    if (type == directionPOI)
+    {
+      peakPositive = std::max(peakPositive, POILevel);
+      peakNegative = std::min(peakNegative, POILevel);
+    }
+    state.track(level, 0);
+
+    // The peaks decay towards zero during silence and are flushed before they become subnormal.
+    peakPositive *= decay;
+    peakNegative *= decay;
+    peakPositive = (peakPositive < DENORMAL_LEVEL) ? 0. : peakPositive;
+    peakNegative = (peakNegative > -DENORMAL_LEVEL) ? 0. : peakNegative;
+
+    iplug::sample nextLevel = 0.;
+    if (state.isIncreasing)
+    {
+      nextLevel = (level < 0) ? 0. : std::max(peakPositive, level);
+    }
+    else
+    {
+      nextLevel = (level > 0) ? 0. : std::min(peakNegative, level);
+    }
+    norm.setLevels(lastLevel, nextLevel);
+  }
+
+  bool isIncreasing() const
+  {
+    return state.isIncreasing;
+  }
+
+private:
+  SampleState state;
+
+  // Level of the previous POI.
+  iplug::sample lastLevel = 0.;
+
+  // Decaying levels of the recent maxima and minima.
+  iplug::sample peakPositive = 0.;
+  iplug::sample peakNegative = 0.;
+};
@@ -0,0 +1,81 @@
+// Fixed-capacity FIFO queue used on the audio thread.
+//
+// Memory is only allocated by allocate, which must be called outside of the audio processing
+// (e.g. in OnReset). Pushing, popping and clearing never allocate and run in constant time.
+
+#pragma once
+
+#include <vector>
+
+template <typename T>
+class RingBuffer
+{
+  std::vector<T> data;
+
+  // data.size() - 1. The capacity is a power of two, so indices wrap with a bitwise and.
+  int mask = -1;
+
+  // Index of the front element in data.
+  int head = 0;
+
+  // Number of elements in the queue.
+  int count = 0;
+
+public:
+  // Makes room for at least minCapacity elements and clears the queue.
+  // Only allocates if the current capacity is too small.
+  void allocate(int minCapacity)
+  {
+    int newCapacity = 1;
+    while (newCapacity < minCapacity)
+    {
+      newCapacity *= 2;
+    }
+    if (newCapacity > capacity())
+    {
+      data.assign(newCapacity, T());
+      mask = newCapacity - 1;
+    }
+    clear();
+  }
+
+  // Appends value to the back of the queue.
+  // * @return false if the queue is full, in which case value is discarded.
+  bool push(const T& value)
+  {
+    if (count > mask) return false;
+
+    data[(head + count) & mask] = value;
+    count++;
+    return true;
+  }
+
+  // Removes the front element. The queue must not be empty.
+  void pop()
+  {
+    head = (head + 1) & mask;
+    count--;
+  }
+
+  // Removes all elements.
+  void clear()
+  {
+    head = 0;
+    count = 0;
+  }
+
+  // * @return The element at position idx, counted from the front. idx must be smaller than size().
+  T& at(int idx) { return data[(head + idx) & mask]; }
+  const T& at(int idx) const { return data[(head + idx) & mask]; }
+
+  T& front() { return at(0); }
+  const T& front() const { return at(0); }
+
+  T& back() { return at(count - 1); }
+  const T& back() const { return at(count - 1); }
+
+  int size() const { return count; }
+  int capacity() const { return mask + 1; }
+  bool empty() const { return count == 0; }
+  bool full() const { return count == capacity(); }
+};
@@ -0,0 +1,291 @@
+// Thin wrappers around the SIMD intrinsics used by the audio processing kernels.
+//
+// Kernels are written once against the functions in this file. If the compiler targets AVX2,
+// a SIMDFloat holds eight floats, else if SSE2 is available it holds four floats. On other
+// architectures UDS_SIMD is not defined and the kernels must fall back to scalar code.
+// There is no runtime dispatch, the instruction set is chosen by the build flags
+// (e.g. /arch:AVX2 on MSVC, -mavx2 on clang/gcc).
+
+#pragma once
+
+#if defined(__AVX2__)
+#define UDS_SIMD
+#define UDS_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define UDS_SIMD
+#define UDS_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef UDS_SIMD
+
+#ifdef UDS_AVX2
+typedef __m256 SIMDFloat;
+typedef __m256i SIMDInt;
+
+// Number of floats in a SIMDFloat.
+constexpr int SIMD_WIDTH = 8;
+
+inline SIMDFloat simdLoad(const float* p) { return _mm256_loadu_ps(p); }
+inline void simdStore(float* p, SIMDFloat a) { _mm256_storeu_ps(p, a); }
+inline SIMDFloat simdSet(float a) { return _mm256_set1_ps(a); }
+inline SIMDFloat simdZero() { return _mm256_setzero_ps(); }
+inline SIMDFloat simdAdd(SIMDFloat a, SIMDFloat b) { return _mm256_add_ps(a, b); }
+inline SIMDFloat simdSub(SIMDFloat a, SIMDFloat b) { return _mm256_sub_ps(a, b); }
+inline SIMDFloat simdMul(SIMDFloat a, SIMDFloat b) { return _mm256_mul_ps(a, b); }
+inline SIMDFloat simdDiv(SIMDFloat a, SIMDFloat b) { return _mm256_div_ps(a, b); }
+inline SIMDFloat simdMin(SIMDFloat a, SIMDFloat b) { return _mm256_min_ps(a, b); }
+inline SIMDFloat simdMax(SIMDFloat a, SIMDFloat b) { return _mm256_max_ps(a, b); }
+inline SIMDFloat simdAnd(SIMDFloat a, SIMDFloat b) { return _mm256_and_ps(a, b); }
+inline SIMDFloat simdAndNot(SIMDFloat a, SIMDFloat b) { return _mm256_andnot_ps(a, b); }
+inline SIMDFloat simdOr(SIMDFloat a, SIMDFloat b) { return _mm256_or_ps(a, b); }
+inline SIMDFloat simdXor(SIMDFloat a, SIMDFloat b) { return _mm256_xor_ps(a, b); }
+inline SIMDFloat simdLess(SIMDFloat a, SIMDFloat b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+inline SIMDFloat simdGreater(SIMDFloat a, SIMDFloat b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+inline SIMDFloat simdEqual(SIMDFloat a, SIMDFloat b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+inline SIMDFloat simdNotEqual(SIMDFloat a, SIMDFloat b) { return _mm256_cmp_ps(a, b, _CMP_NEQ_UQ); }
+inline int simdMoveMask(SIMDFloat mask) { return _mm256_movemask_ps(mask); }
+
+// Returns a where mask is set and b elsewhere.
+inline SIMDFloat simdSelect(SIMDFloat mask, SIMDFloat a, SIMDFloat b) { return _mm256_blendv_ps(b, a, mask); }
+
+inline SIMDInt simdIntLoad(const int* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+inline void simdIntStore(int* p, SIMDInt a) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), a); }
+inline SIMDInt simdIntSet(int a) { return _mm256_set1_epi32(a); }
+inline SIMDInt simdIntAdd(SIMDInt a, SIMDInt b) { return _mm256_add_epi32(a, b); }
+inline SIMDInt simdIntSub(SIMDInt a, SIMDInt b) { return _mm256_sub_epi32(a, b); }
+inline SIMDInt simdIntMax(SIMDInt a, SIMDInt b) { return _mm256_max_epi32(a, b); }
+inline SIMDInt simdIntMin(SIMDInt a, SIMDInt b) { return _mm256_min_epi32(a, b); }
+inline SIMDInt simdIntShiftLeft(SIMDInt a, int n) { return _mm256_slli_epi32(a, n); }
+inline SIMDInt simdIntShiftRight(SIMDInt a, int n) { return _mm256_srli_epi32(a, n); }
+inline SIMDInt simdIntAnd(SIMDInt a, SIMDInt b) { return _mm256_and_si256(a, b); }
+inline SIMDInt simdIntOr(SIMDInt a, SIMDInt b) { return _mm256_or_si256(a, b); }
+inline SIMDInt simdCastToInt(SIMDFloat a) { return _mm256_castps_si256(a); }
+inline SIMDFloat simdCastToFloat(SIMDInt a) { return _mm256_castsi256_ps(a); }
+inline SIMDInt simdRoundToInt(SIMDFloat a) { return _mm256_cvtps_epi32(a); }
+inline SIMDFloat simdIntToFloat(SIMDInt a) { return _mm256_cvtepi32_ps(a); }
+
+// Loads base[idx[0]], ..., base[idx[SIMD_WIDTH - 1]].
+inline SIMDFloat simdGather(const float* base, SIMDInt idx) { return _mm256_i32gather_ps(base, idx, 4); }
+
+typedef __m256d SIMDDouble;
+
+// Number of doubles in a SIMDDouble.
+constexpr int SIMD_DOUBLE_WIDTH = 4;
+
+inline SIMDDouble simdDoubleLoad(const double* p) { return _mm256_loadu_pd(p); }
+inline SIMDDouble simdDoubleZero() { return _mm256_setzero_pd(); }
+inline SIMDDouble simdDoubleSub(SIMDDouble a, SIMDDouble b) { return _mm256_sub_pd(a, b); }
+inline SIMDDouble simdDoubleMul(SIMDDouble a, SIMDDouble b) { return _mm256_mul_pd(a, b); }
+inline SIMDDouble simdDoubleAnd(SIMDDouble a, SIMDDouble b) { return _mm256_and_pd(a, b); }
+inline SIMDDouble simdDoubleGreater(SIMDDouble a, SIMDDouble b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+inline int simdDoubleMoveMask(SIMDDouble mask) { return _mm256_movemask_pd(mask); }
+
+#else
+typedef __m128 SIMDFloat;
+typedef __m128i SIMDInt;
+
+// Number of floats in a SIMDFloat.
+constexpr int SIMD_WIDTH = 4;
+
+inline SIMDFloat simdLoad(const float* p) { return _mm_loadu_ps(p); }
+inline void simdStore(float* p, SIMDFloat a) { _mm_storeu_ps(p, a); }
+inline SIMDFloat simdSet(float a) { return _mm_set1_ps(a); }
+inline SIMDFloat simdZero() { return _mm_setzero_ps(); }
+inline SIMDFloat simdAdd(SIMDFloat a, SIMDFloat b) { return _mm_add_ps(a, b); }
+inline SIMDFloat simdSub(SIMDFloat a, SIMDFloat b) { return _mm_sub_ps(a, b); }
+inline SIMDFloat simdMul(SIMDFloat a, SIMDFloat b) { return _mm_mul_ps(a, b); }
+inline SIMDFloat simdDiv(SIMDFloat a, SIMDFloat b) { return _mm_div_ps(a, b); }
+inline SIMDFloat simdMin(SIMDFloat a, SIMDFloat b) { return _mm_min_ps(a, b); }
+inline SIMDFloat simdMax(SIMDFloat a, SIMDFloat b) { return _mm_max_ps(a, b); }
+inline SIMDFloat simdAnd(SIMDFloat a, SIMDFloat b) { return _mm_and_ps(a, b); }
+inline SIMDFloat simdAndNot(SIMDFloat a, SIMDFloat b) { return _mm_andnot_ps(a, b); }
+inline SIMDFloat simdOr(SIMDFloat a, SIMDFloat b) { return _mm_or_ps(a, b); }
+inline SIMDFloat simdXor(SIMDFloat a, SIMDFloat b) { return _mm_xor_ps(a, b); }
+inline SIMDFloat simdLess(SIMDFloat a, SIMDFloat b) { return _mm_cmplt_ps(a, b); }
+inline SIMDFloat simdGreater(SIMDFloat a, SIMDFloat b) { return _mm_cmpgt_ps(a, b); }
+inline SIMDFloat simdEqual(SIMDFloat a, SIMDFloat b) { return _mm_cmpeq_ps(a, b); }
+inline SIMDFloat simdNotEqual(SIMDFloat a, SIMDFloat b) { return _mm_cmpneq_ps(a, b); }
+inline int simdMoveMask(SIMDFloat mask) { return _mm_movemask_ps(mask); }
+
+// Returns a where mask is set and b elsewhere.
+inline SIMDFloat simdSelect(SIMDFloat mask, SIMDFloat a, SIMDFloat b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+
+inline SIMDInt simdIntLoad(const int* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+inline void simdIntStore(int* p, SIMDInt a) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), a); }
+inline SIMDInt simdIntSet(int a) { return _mm_set1_epi32(a); }
+inline SIMDInt simdIntAdd(SIMDInt a, SIMDInt b) { return _mm_add_epi32(a, b); }
+inline SIMDInt simdIntSub(SIMDInt a, SIMDInt b) { return _mm_sub_epi32(a, b); }
+inline SIMDInt simdIntShiftLeft(SIMDInt a, int n) { return _mm_slli_epi32(a, n); }
+inline SIMDInt simdIntShiftRight(SIMDInt a, int n) { return _mm_srli_epi32(a, n); }
+inline SIMDInt simdIntAnd(SIMDInt a, SIMDInt b) { return _mm_and_si128(a, b); }
+inline SIMDInt simdIntOr(SIMDInt a, SIMDInt b) { return _mm_or_si128(a, b); }
+inline SIMDInt simdCastToInt(SIMDFloat a) { return _mm_castps_si128(a); }
+inline SIMDFloat simdCastToFloat(SIMDInt a) { return _mm_castsi128_ps(a); }
+inline SIMDInt simdRoundToInt(SIMDFloat a) { return _mm_cvtps_epi32(a); }
+inline SIMDFloat simdIntToFloat(SIMDInt a) { return _mm_cvtepi32_ps(a); }
+
+// SSE2 has no integer min/max for 32 bit integers, emulate them with compares.
+inline SIMDInt simdIntMax(SIMDInt a, SIMDInt b)
+{
+  __m128i greater = _mm_cmpgt_epi32(a, b);
+  return _mm_or_si128(_mm_and_si128(greater, a), _mm_andnot_si128(greater, b));
+}
+inline SIMDInt simdIntMin(SIMDInt a, SIMDInt b)
+{
+  __m128i less = _mm_cmplt_epi32(a, b);
+  return _mm_or_si128(_mm_and_si128(less, a), _mm_andnot_si128(less, b));
+}
+
+// Loads base[idx[0]], ..., base[idx[SIMD_WIDTH - 1]].
+// SSE2 has no gather instruction, the elements are loaded one by one.
+inline SIMDFloat simdGather(const float* base, SIMDInt idx)
+{
+  alignas(16) int i[4];
+  _mm_store_si128(reinterpret_cast<__m128i*>(i), idx);
+  return _mm_setr_ps(base[i[0]], base[i[1]], base[i[2]], base[i[3]]);
+}
+
+typedef __m128d SIMDDouble;
+
+// Number of doubles in a SIMDDouble.
+constexpr int SIMD_DOUBLE_WIDTH = 2;
+
+inline SIMDDouble simdDoubleLoad(const double* p) { return _mm_loadu_pd(p); }
+inline SIMDDouble simdDoubleZero() { return _mm_setzero_pd(); }
+inline SIMDDouble simdDoubleSub(SIMDDouble a, SIMDDouble b) { return _mm_sub_pd(a, b); }
+inline SIMDDouble simdDoubleMul(SIMDDouble a, SIMDDouble b) { return _mm_mul_pd(a, b); }
+inline SIMDDouble simdDoubleAnd(SIMDDouble a, SIMDDouble b) { return _mm_and_pd(a, b); }
+inline SIMDDouble simdDoubleGreater(SIMDDouble a, SIMDDouble b) { return _mm_cmpgt_pd(a, b); }
+inline int simdDoubleMoveMask(SIMDDouble mask) { return _mm_movemask_pd(mask); }
+#endif
+
+// Two doubles holding the left and right channel of one sample, independent of the SIMD width.
+typedef __m128d SIMDStereo;
+
+inline SIMDStereo simdStereoSet(double left, double right) { return _mm_set_pd(right, left); }
+inline SIMDStereo simdStereoMask(bool left, bool right) { return _mm_castsi128_pd(_mm_set_epi64x(right ? -1 : 0, left ? -1 : 0)); }
+inline SIMDStereo simdStereoGreater(SIMDStereo a, SIMDStereo b) { return _mm_cmpgt_pd(a, b); }
+inline SIMDStereo simdStereoNotEqual(SIMDStereo a, SIMDStereo b) { return _mm_cmpneq_pd(a, b); }
+
+// Returns a where mask is set and b elsewhere.
+inline SIMDStereo simdStereoSelect(SIMDStereo mask, SIMDStereo a, SIMDStereo b) { return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b)); }
+
+// * @return Bit 0 is the mask of the left, bit 1 of the right channel
+inline int simdStereoMoveMask(SIMDStereo mask) { return _mm_movemask_pd(mask); }
+
+inline SIMDFloat simdAbs(SIMDFloat a) { return simdAndNot(simdSet(-0.f), a); }
+
+// * @return The sign bits of a, all other bits are zero.
+inline SIMDFloat simdSignBits(SIMDFloat a) { return simdAnd(simdSet(-0.f), a); }
+
+// Base 2 logarithm for inputs > 0. Inputs <= FLT_MIN (including zero and subnormals) return -126.
+//
+// Uses the cephes logf polynomial, the result is accurate to a few ulp.
+inline SIMDFloat simdLog2(SIMDFloat a)
+{
+  a = simdMax(a, simdSet(1.17549435e-38f));
+
+  // Split a into mantissa m in [0.5, 1) and exponent e.
+  SIMDInt bits = simdCastToInt(a);
+  SIMDFloat e = simdIntToFloat(simdIntSub(simdIntShiftRight(bits, 23), simdIntSet(126)));
+  SIMDFloat m = simdCastToFloat(simdIntOr(simdIntAnd(bits, simdIntSet(0x007fffff)), simdIntSet(0x3f000000)));
+
+  // Shift the mantissa to [sqrt(0.5), sqrt(2)) to keep the polynomial argument small.
+  SIMDFloat smallMask = simdLess(m, simdSet(0.707106781186547524f));
+  e = simdSub(e, simdAnd(smallMask, simdSet(1.f)));
+  SIMDFloat x = simdSub(simdAdd(m, simdAnd(smallMask, m)), simdSet(1.f));
+
+  SIMDFloat z = simdMul(x, x);
+  SIMDFloat y = simdSet(7.0376836292e-2f);
+  y = simdAdd(simdMul(y, x), simdSet(-1.1514610310e-1f));
+  y = simdAdd(simdMul(y, x), simdSet(1.1676998740e-1f));
+  y = simdAdd(simdMul(y, x), simdSet(-1.2420140846e-1f));
+  y = simdAdd(simdMul(y, x), simdSet(1.4249322787e-1f));
+  y = simdAdd(simdMul(y, x), simdSet(-1.6668057665e-1f));
+  y = simdAdd(simdMul(y, x), simdSet(2.0000714765e-1f));
+  y = simdAdd(simdMul(y, x), simdSet(-2.4999993993e-1f));
+  y = simdAdd(simdMul(y, x), simdSet(3.3333331174e-1f));
+  y = simdMul(simdMul(y, x), z);
+  y = simdSub(y, simdMul(z, simdSet(0.5f)));
+
+  // ln(m) = x + y, log2(a) = e + ln(m) / ln(2).
+  return simdAdd(e, simdMul(simdAdd(x, y), simdSet(1.44269504088896341f)));
+}
+
+// 2^a for a <= 0. Results that would be smaller than FLT_MIN are flushed to zero.
+//
+// Uses the cephes expf polynomial, the result is accurate to a few ulp.
+inline SIMDFloat simdExp2(SIMDFloat a)
+{
+  SIMDFloat underflow = simdLess(a, simdSet(-126.f));
+  a = simdMax(a, simdSet(-126.f));
+
+  // Split a into an integer n and a remainder r in [-0.5, 0.5].
+  SIMDInt n = simdRoundToInt(a);
+  SIMDFloat r = simdMul(simdSub(a, simdIntToFloat(n)), simdSet(0.693147180559945309f));
+
+  SIMDFloat z = simdMul(r, r);
+  SIMDFloat y = simdSet(1.9875691500e-4f);
+  y = simdAdd(simdMul(y, r), simdSet(1.3981999507e-3f));
+  y = simdAdd(simdMul(y, r), simdSet(8.3334519073e-3f));
+  y = simdAdd(simdMul(y, r), simdSet(4.1665795894e-2f));
+  y = simdAdd(simdMul(y, r), simdSet(1.6666665459e-1f));
+  y = simdAdd(simdMul(y, r), simdSet(5.0000001201e-1f));
+  y = simdAdd(simdAdd(simdMul(y, z), r), simdSet(1.f));
+
+  // Multiply by 2^n by adding n to the exponent bits.
+  y = simdCastToFloat(simdIntAdd(simdCastToInt(y), simdIntShiftLeft(n, 23)));
+  return simdAndNot(underflow, y);
+}
+
+// a^p for 0 <= a <= 1 and p > 0. Subnormal inputs are treated as zero.
+inline SIMDFloat simdPow(SIMDFloat a, SIMDFloat p)
+{
+  SIMDFloat isZero = simdLess(a, simdSet(1.17549435e-38f));
+  return simdAndNot(isZero, simdExp2(simdMul(p, simdLog2(a))));
+}
+
+#endif
+
+// Sets the floating point unit to flush subnormal results to zero (FTZ) and to treat
+// subnormal inputs as zero (DAZ) for the lifetime of the object, and restores the previous
+// mode afterwards. Arithmetic on subnormals can be orders of magnitude slower than on
+// normal numbers, which shows as CPU spikes on fades and decaying tails.
+// The mode only applies to the current thread. On architectures other than x86 and ARM64,
+// the guard does nothing.
+class ScopedFlushDenormals
+{
+public:
+  ScopedFlushDenormals()
+  {
+#if defined(UDS_SIMD)
+    previousMode = _mm_getcsr();
+    _mm_setcsr(previousMode | 0x8040);
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+    __asm__ __volatile__("mrs %0, fpcr" : "=r"(previousMode));
+    __asm__ __volatile__("msr fpcr, %0" : : "r"(previousMode | (1ull << 24)));
+#endif
+  }
+
+  ~ScopedFlushDenormals()
+  {
+#if defined(UDS_SIMD)
+    _mm_setcsr(previousMode);
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+    __asm__ __volatile__("msr fpcr, %0" : : "r"(previousMode));
+#endif
+  }
+
+  ScopedFlushDenormals(const ScopedFlushDenormals&) = delete;
+  ScopedFlushDenormals& operator=(const ScopedFlushDenormals&) = delete;
+
+private:
+  // MXCSR on x86, FPCR on ARM64.
+#if defined(UDS_SIMD)
+  unsigned int previousMode = 0;
+#else
+  unsigned long long previousMode = 0;
+#endif
+};
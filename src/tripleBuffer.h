@@ -0,0 +1,58 @@
+// Hands data from the UI thread to the audio thread without locks.
+//
+// The UI thread owns the back buffer, the audio thread owns the front buffer and the middle
+// buffer holds the most recent published data. Both sides only exchange buffer indices through
+// one atomic, so neither thread can block the other and a buffer is never written while the
+// audio thread reads it. Buffers are reused instead of being freed.
+
+#pragma once
+
+#include <atomic>
+
+template <typename T>
+class TripleBuffer
+{
+  // Set in middle if the middle buffer holds data the audio thread has not acquired yet.
+  static constexpr int newSnapshot = 4;
+
+  T buffers[3];
+
+  // Index of the middle buffer, possibly combined with newSnapshot.
+  std::atomic<int> middle{1};
+
+  // Index of the buffer owned by the UI thread.
+  int back = 0;
+
+  // Index of the buffer owned by the audio thread.
+  int front = 2;
+
+public:
+  TripleBuffer() = default;
+
+  // Initializes all buffers with a copy of init.
+  explicit TripleBuffer(const T& init)
+    : buffers{init, init, init}
+  {
+  }
+
+  // * @return The back buffer, to be filled before publish. Its content is not the most recently
+  // published data. Must only be called on the UI thread.
+  T& getBack() { return buffers[back]; }
+
+  // Makes the back buffer the middle buffer. Must only be called on the UI thread.
+  void publish()
+  {
+    back = middle.exchange(back | newSnapshot, std::memory_order_acq_rel) & ~newSnapshot;
+  }
+
+  // Takes over the middle buffer if newer data has been published. Must only be called on the audio thread.
+  // * @return The most recent data, which stays valid until the next call.
+  const T& acquire()
+  {
+    if (middle.load(std::memory_order_relaxed) & newSnapshot)
+    {
+      front = middle.exchange(front, std::memory_order_acq_rel) & ~newSnapshot;
+    }
+    return buffers[front];
+  }
+};